@@ -1,290 +1,579 @@
 ﻿#pragma once
 #include "domain.h"
 #include "framework.h"
+#include "trail-map.h"
+#include "food-map.h"
+#include "obstacle-map.h"
+#include "trace.h"
+#include "perf-counters.h"
+
+#include <cstring>
+
+// Working copy of one agent, loaded from and stored back to the pool's arrays.
+struct AgentState {
+    uint64_t id;
+    Vector2f position;
+    Vector2f choosen_food_position;
+    Vector2f last_reached_food;
+    float cos_heading;
+    float sin_heading;
+    float weight;
+    float fitness;
+    int turn;               // -1, 0 or 1: the side the trail turned the agent to this step
+};
+
+// The mode flags one step of the agents runs under. Each combination gets its own copy of
+// the step kernel, picked once per step, so the per-agent loops do not test them.
+template <bool IsMaze, bool IsPolling, bool HasFood, bool IsRun>
+struct StepPolicy {
+    static constexpr bool IS_MAZE = IsMaze;
+    static constexpr bool IS_POLLING = IsPolling;
+    static constexpr bool HAS_FOOD = HasFood;
+    static constexpr bool IS_RUN = IsRun;
+};
+
+// Calls body(StepPolicy<...>()) with the runtime flags as template arguments.
+template <bool... Flags, typename Body>
+void SelectStepPolicy(const Body& body) {
+    body(StepPolicy<Flags...>());
+}
+
+template <bool... Flags, typename Body, typename... Rest>
+void SelectStepPolicy(const Body& body, bool flag, Rest... rest) {
+    if (flag) SelectStepPolicy<Flags..., true>(body, rest...);
+    else SelectStepPolicy<Flags..., false>(body, rest...);
+}
+
+// Everything one task of the evaluate and move phases writes outside its own agents.
+// The engine merges the buffers in task order once a phase is complete.
+struct UpdateBuffer {
+    FitnessRange range;
+    float best_agent_fitness;
+    Vector2f best_position;
+    std::vector<uint32_t> deposits;
+    std::vector<float> sensor_choices;
+    std::vector<AgentState> states;
+
+    void Reset() {
+        range = { std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest() };
+        best_agent_fitness = std::numeric_limits<float>::max();
+        // An agent deposits at most once a step, so a task never outgrows this.
+        deposits.clear();
+        deposits.reserve(simulation::AGENTS_PER_TASK);
+    }
+};
 
-class Agent {
+class AgentPool {
 public:
-    Agent(const std::vector<Agent*>& agents) : population_(agents) {
-        InitializePositionAndHeading();
-        weight_ = 0.0f;
-        fitness_ = std::numeric_limits<float>::max();
+    AgentPool() = default;
+
+    AgentPool(size_t count, const RandomStream& random, const SimulationContext& context) : context_(&context) {
         PrecomputeSensorVectors();
-        UpdateCosSin();
+        PrecomputeTurn();
+        Resize(count);
+        std::iota(id_.begin(), id_.end(), 0u);
+        for (size_t i = 0; i < count; ++i) {
+            auto [pos, heading] = InitiliseMode(*context_, random, i);
+            x_[i] = pos.x;
+            y_[i] = pos.y;
+            const float rad = heading * constant::PI / 180.0f;
+            cos_heading_[i] = cosf(rad);
+            sin_heading_[i] = sinf(rad);
+        }
     }
 
-    void Update(sf::Image& trail_map, const std::vector<sf::Vector2f>& food_positions) {
-        weight_ = 0.0f;
-        if (!food_positions.empty()) {
-            UpdateFoodRelatedData(food_positions);
-            UpdatePositionBasedOnFood(trail_map);
-        }
+    size_t Size() const { return x_.size(); }
 
-        Exploration(trail_map, food_positions);
-        UpdateCosSin();
-        NormalizeHeading();
+    Vector2f GetPos(size_t i) const { return { x_[i], y_[i] }; }
+    float GetWeight(size_t i) const { return weight_[i]; }
+    // The heading in degrees, [0, 360); the pool keeps only the unit vector.
+    float GetHeading(size_t i) const {
+        const float heading = atan2f(sin_heading_[i], cos_heading_[i]) * 180.0f / constant::PI;
+        return heading < 0.0f ? heading + 360.0f : heading;
+    }
+    uint32_t GetId(size_t i) const { return id_[i]; }
+
+    // What the pool keeps per agent: seven state floats, the fitness and position scratch
+    // and the id, 44 bytes against about 88 for the former Agent object and its pointer.
+    // Permute adds four bytes of id scratch once agents are reordered.
+    static constexpr size_t BYTES_PER_AGENT = 10 * sizeof(float) + sizeof(uint32_t);
+    static constexpr size_t STATE_ARRAY_COUNT = 7;
+
+    // Every per-agent array that carries state from one step to the next. The fitness and
+    // the food target are recomputed every step before they are read, and the position back
+    // buffers are scratch, so none of them is part of it. The heading is kept only as a unit
+    // vector, which turns rotate by precomputed angles.
+    std::array<const std::vector<float>*, STATE_ARRAY_COUNT> GetStateArrays() const {
+        return { &x_, &y_, &weight_, &last_food_x_, &last_food_y_, &cos_heading_, &sin_heading_ };
     }
 
-    sf::Vector2f GetPos() const { return position_; }
-    float GetWeight() const { return weight_; }
+    std::array<std::vector<float>*, STATE_ARRAY_COUNT> GetStateArrays() {
+        return { &x_, &y_, &weight_, &last_food_x_, &last_food_y_, &cos_heading_, &sin_heading_ };
+    }
 
-private:
-    Sensor sensor_;
-    const std::vector<Agent*>& population_;
-
-    sf::Vector2f position_;
-    sf::Vector2f choosen_food_position_;
-    sf::Vector2f last_reached_food_;
-    
-    float heading_;
-    float cos_heading_;
-    float sin_heading_;
-    float weight_;
-    float fitness_;
-
-    void InitializePositionAndHeading() {
-        auto [pos, heading] = InitiliseMode();
-        position_ = pos;
-        heading_ = heading;
-    }
-
-    void UpdateFoodRelatedData(const std::vector<sf::Vector2f>& food_positions) {
-        weight_ = CalculateCombinedWeight(position_, food_positions);
-        fitness_ = CalculateFitness(food_positions);
-        population::BEST_FITNESS = std::min(population::BEST_FITNESS, fitness_);
-
-        const float p = tanh(std::abs(population::BEST_FITNESS - fitness_));
-        const float random = ScaleToRange01(Hash(rand()));
-
-        const sf::Vector2f XA = GetRandomAgentPosition();
-        const sf::Vector2f XB = GetRandomAgentPosition();
-        const float vb = CalculateVB();
-        const float vc = CalculateVC();
-        population::BEST_POSITION = FindGlobalBestFood(food_positions);
-
-        if (random < p) choosen_food_position_ = population::BEST_POSITION + vb * (weight_ * XA - XB);
-        else choosen_food_position_ = vc * position_;
-    }
-
-    float CalculateFitness(const std::vector<sf::Vector2f>& food_positions) {
-        float fitness = std::numeric_limits<float>::max();
-        for (const auto& food : food_positions) {
-            float fitness_func = FitnessFunc(position_, food);
-            if (fitness_func < fitness) fitness = fitness_func;
+    // Sets every agent's heading vector from headings in degrees, for state saved as those.
+    void SetHeadings(const float* headings) {
+        for (size_t i = 0; i < Size(); ++i) {
+            const float rad = headings[i] * constant::PI / 180.0f;
+            cos_heading_[i] = cosf(rad);
+            sin_heading_[i] = sinf(rad);
         }
-        return fitness;
     }
 
-    void UpdatePositionBasedOnFood(sf::Image& trail_map) {
-        if (Distance(choosen_food_position_, position_) < 5.0f) {
-            DepositPheromone(trail_map);
-            last_reached_food_ = choosen_food_position_;
+    // Random draws are keyed by an agent's id rather than its slot, so an agent draws the
+    // same numbers wherever reordering or migration to another rank has put it.
+    const std::vector<uint32_t>& GetIds() const { return id_; }
+    std::vector<uint32_t>& GetIds() { return id_; }
+
+    // Partners for the SMA update are drawn from `partners` instead of the pool, when set.
+    void SetPartners(const std::vector<Vector2f>* partners) { partners_ = partners; }
+
+    // An agent as a record of RECORD_BYTES: its id, then one float from each state array.
+    static constexpr size_t RECORD_BYTES = sizeof(uint32_t) + STATE_ARRAY_COUNT * sizeof(float);
+
+    void WriteRecord(size_t i, std::vector<uint8_t>& out) const {
+        const size_t offset = out.size();
+        out.resize(offset + RECORD_BYTES);
+        std::memcpy(&out[offset], &id_[i], sizeof(uint32_t));
+        const auto arrays = GetStateArrays();
+        for (size_t a = 0; a < arrays.size(); ++a) {
+            std::memcpy(&out[offset + sizeof(uint32_t) + a * sizeof(float)], &(*arrays[a])[i], sizeof(float));
         }
     }
 
-    void Exploration(sf::Image& trail_map, const std::vector<sf::Vector2f>& food_positions) {
-        sf::Vector2f new_position = CalculateNewPosition();
-        HandleCollisions(new_position);
-        if (mode::IS_RUN) position_ = new_position;
-        FollowPheromoneGradient(trail_map, food_positions);
+    void AppendRecords(const uint8_t* records, size_t count) {
+        const size_t first = Size();
+        Resize(first + count);
+        const auto arrays = GetStateArrays();
+        for (size_t k = 0; k < count; ++k) {
+            const uint8_t* record = records + k * RECORD_BYTES;
+            std::memcpy(&id_[first + k], record, sizeof(uint32_t));
+            for (size_t a = 0; a < arrays.size(); ++a) {
+                std::memcpy(&(*arrays[a])[first + k], record + sizeof(uint32_t) + a * sizeof(float), sizeof(float));
+            }
+        }
     }
 
-    sf::Vector2f CalculateNewPosition() {
-        sf::Vector2f new_position = position_;
-        new_position.x += cos_heading_ * agent::SPEED;
-        new_position.y += sin_heading_ * agent::SPEED;
-        return new_position;
+    // Keeps the agents whose `keep` flag is set, in their current order.
+    void Compact(const std::vector<uint8_t>& keep) {
+        size_t kept = 0;
+        const auto arrays = GetStateArrays();
+        for (size_t i = 0; i < Size(); ++i) {
+            if (!keep[i]) continue;
+            id_[kept] = id_[i];
+            for (auto* values : arrays) (*values)[kept] = (*values)[i];
+            ++kept;
+        }
+        Resize(kept);
     }
 
-    void HandleCollisions(sf::Vector2f& new_position) {
-        if (mode::IS_MAZE && IsWallCollision(new_position)) {
-            HandleMazeCollision(new_position);
+    // Evaluate phase: fitness of agents [begin, end) and its min/max over the range, reduced
+    // into the buffer. Only writes the agents' own fitness, so any ranges may run concurrently.
+    void Evaluate(size_t begin, size_t end, const FoodMap& food_map, UpdateBuffer& buffer) {
+        if (food_map.IsEmpty()) return;
+        SLIME_PERF_SCOPE(perf::FOOD_EVAL);
+
+        for (size_t i = begin; i < end; ++i) {
+            const Vector2f position = { x_[i], y_[i] };
+            const FoodMap::Entry food = food_map.Lookup(position);
+            const float fitness = FitnessFunc(position, food_map.GetFood(food.nearest));
+            fitness_[i] = fitness;
+
+            buffer.range.best = std::min(buffer.range.best, fitness);
+            buffer.range.worst = std::max(buffer.range.worst, fitness);
+            if (fitness < buffer.best_agent_fitness) {
+                buffer.best_agent_fitness = fitness;
+                buffer.best_position = SelectBestFood(food_map, food, { last_food_x_[i], last_food_y_[i] });
+            }
         }
-        if (IsBorder(new_position)) {
-            HandleBorderCollision(new_position);
+    }
+
+    // Move phase for agents [begin, end) against the reduced population range. Partners are read
+    // from the current positions while new ones go to the back buffer, so any ranges may run
+    // concurrently as long as each has its own buffer. SwapPositions publishes the result.
+    void Move(size_t begin, size_t end, const TrailMap& trail_map, const FoodMap& food_map, const ObstacleMap& obstacles,
+        const FitnessRange& range, const RandomStream& random, UpdateBuffer& buffer) {
+        SelectStepPolicy([&](auto policy) {
+            MoveRange<decltype(policy)>(begin, end, trail_map, food_map, obstacles, range, random, buffer);
+            }, context_->is_maze, context_->is_polling, !food_map.IsEmpty(), context_->is_run);
+    }
+
+    void SwapPositions() {
+        x_.swap(next_x_);
+        y_.swap(next_y_);
+    }
+
+    // Rearranges the agents so that slot i holds the agent that was in slot order[i].
+    void Permute(const std::vector<uint32_t>& order, ThreadPool& pool) {
+        for (auto* values : GetStateArrays()) {
+            pool.ParallelFor(order.size(), 1 << 16, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) next_x_[i] = (*values)[order[i]];
+                });
+            values->swap(next_x_);
         }
+        next_id_.resize(order.size());
+        for (size_t i = 0; i < order.size(); ++i) next_id_[i] = id_[order[i]];
+        id_.swap(next_id_);
     }
 
-    void HandleMazeCollision(sf::Vector2f& new_position) {
-        int cell_x = static_cast<int>(position_.x / maze::CELL_SIZE);
-        int cell_y = static_cast<int>(position_.y / maze::CELL_SIZE);
+private:
+    Sensor sensor_;
 
-        float cell_left = cell_x * maze::CELL_SIZE;
-        float cell_right = cell_left + maze::CELL_SIZE;
-        float cell_top = cell_y * maze::CELL_SIZE;
-        float cell_bottom = cell_top + maze::CELL_SIZE;
+    std::vector<float> x_;
+    std::vector<float> y_;
+    std::vector<float> weight_;
+    std::vector<float> fitness_;
+    std::vector<float> last_food_x_;
+    std::vector<float> last_food_y_;
+    std::vector<float> next_x_;
+    std::vector<float> next_y_;
+    std::vector<float> cos_heading_;
+    std::vector<float> sin_heading_;
+    std::vector<uint32_t> id_;
+    std::vector<uint32_t> next_id_;
+    const std::vector<Vector2f>* partners_ = nullptr;
+    const SimulationContext* context_ = nullptr;
+    float turn_cos_ = 1.0f;
+    float turn_sin_ = 0.0f;
+
+    // With food the turn grows as the agent's weight falls, so its sine and cosine are kept
+    // for weights a table step apart; the bit of angle between two steps is added by series.
+    static constexpr size_t FOOD_TURN_STEPS = 256;
+    static constexpr float FOOD_TURN_MAX_WEIGHT = 2.0f;
+    std::array<float, FOOD_TURN_STEPS + 1> food_turn_cos_{};
+    std::array<float, FOOD_TURN_STEPS + 1> food_turn_sin_{};
+    float food_turn_per_step_ = 0.0f;
+
+    // Walls and borders turn an agent by a whole number of degrees from -20 to 20.
+    static constexpr int REDIRECT_SPREAD = 20;
+    std::array<float, 2 * REDIRECT_SPREAD + 1> redirect_cos_{};
+    std::array<float, 2 * REDIRECT_SPREAD + 1> redirect_sin_{};
+
+    // Agents first move, then sense the trail at their new position and turn; the two loops
+    // are separate so the profiler can tell them apart.
+    template <typename Policy>
+    void MoveRange(size_t begin, size_t end, const TrailMap& trail_map, const FoodMap& food_map, const ObstacleMap& obstacles,
+        const FitnessRange& range, const RandomStream& random, UpdateBuffer& buffer) {
+        {
+            SLIME_TRACE_SCOPE("sensor_draws");
+            buffer.sensor_choices.resize(end - begin);
+            random.FillUniform(&id_[begin], draw::SENSOR_CHOICE, buffer.sensor_choices);
+        }
 
-        bool hit_left = (new_position.x < cell_left && position_.x >= cell_left);
-        bool hit_right = (new_position.x > cell_right && position_.x <= cell_right);
-        bool hit_top = (new_position.y < cell_top && position_.y >= cell_top);
-        bool hit_bottom = (new_position.y > cell_bottom && position_.y <= cell_bottom);
+        buffer.states.resize(end - begin);
+        {
+            SLIME_PERF_SCOPE(perf::MOVE);
+            for (size_t i = begin; i < end; ++i) {
+                AgentState state = Load(i);
 
-        float random_angle = ((rand() % 41) - 20);
+                state.weight = 0.0f;
+                if constexpr (Policy::HAS_FOOD) {
+                    UpdateFoodRelatedData(state, food_map, range, random);
+                    UpdatePositionBasedOnFood(state, trail_map, buffer);
+                }
 
-        if (hit_left) new_position.x += maze::CELL_SIZE / 10 + 1;
-        if (hit_right) new_position.x -= maze::CELL_SIZE / 10 + 1;
-        if (hit_top) new_position.y += maze::CELL_SIZE / 10 + 1;
-        if (hit_bottom) new_position.y -= maze::CELL_SIZE / 10 + 1;
+                Exploration<Policy>(state, obstacles, random);
+                buffer.states[i - begin] = state;
+            }
+        }
 
-        if (hit_left || hit_right) {
-            heading_ = 180 - heading_ + random_angle;
+        SLIME_PERF_SCOPE(perf::SENSE);
+        for (size_t i = begin; i < end; ++i) {
+            AgentState& state = buffer.states[i - begin];
+            FollowPheromoneGradient<Policy>(state, trail_map, buffer.sensor_choices[i - begin]);
+            UpdateDirection<Policy>(state);
+            Store(i, state);
         }
-        else if (hit_top || hit_bottom) {
-            heading_ = 360 - heading_ + random_angle;
+    }
+
+    // Keeps the first agents when it grows or shrinks the pool.
+    void Resize(size_t count) {
+        x_.resize(count, 0.0f);
+        y_.resize(count, 0.0f);
+        weight_.resize(count, 0.0f);
+        fitness_.resize(count, std::numeric_limits<float>::max());
+        last_food_x_.resize(count, 0.0f);
+        last_food_y_.resize(count, 0.0f);
+        next_x_.resize(count, 0.0f);
+        next_y_.resize(count, 0.0f);
+        cos_heading_.resize(count, 1.0f);
+        sin_heading_.resize(count, 0.0f);
+        id_.resize(count, 0);
+    }
+
+    AgentState Load(size_t i) const {
+        AgentState state;
+        state.id = id_[i];
+        state.position = { x_[i], y_[i] };
+        state.choosen_food_position = {};
+        state.last_reached_food = { last_food_x_[i], last_food_y_[i] };
+        state.weight = weight_[i];
+        state.fitness = fitness_[i];
+        state.cos_heading = cos_heading_[i];
+        state.sin_heading = sin_heading_[i];
+        state.turn = 0;
+        return state;
+    }
+
+    void Store(size_t i, const AgentState& state) {
+        next_x_[i] = state.position.x;
+        next_y_[i] = state.position.y;
+        cos_heading_[i] = state.cos_heading;
+        sin_heading_[i] = state.sin_heading;
+        weight_[i] = state.weight;
+        last_food_x_[i] = state.last_reached_food.x;
+        last_food_y_[i] = state.last_reached_food.y;
+    }
+
+    void UpdateFoodRelatedData(AgentState& state, const FoodMap& food_map, const FitnessRange& range,
+        const RandomStream& random) {
+        const FoodMap::Entry food = food_map.Lookup(state.position);
+
+        state.weight = CalculateAgentWeight(state.fitness, range, random.Uniform(state.id, draw::FOOD_WEIGHT));
+
+        const float p = tanh(std::abs(range.best - state.fitness));
+        const float choice = random.Uniform(state.id, draw::SMA_CHOICE);
+
+        const Vector2f XA = GetRandomAgentPosition(random.Next(state.id, draw::PARTNER_A));
+        const Vector2f XB = GetRandomAgentPosition(random.Next(state.id, draw::PARTNER_B));
+        const float vb = CalculateVB(random.Uniform(state.id, draw::VB), context_->GetProgress());
+        const float vc = CalculateVC(context_->GetProgress());
+        const Vector2f best_position = FindGlobalBestFood(state, food_map, food);
+
+        if (choice < p) state.choosen_food_position = best_position + vb * (state.weight * XA - XB);
+        else state.choosen_food_position = vc * state.position;
+    }
+
+    void UpdatePositionBasedOnFood(AgentState& state, const TrailMap& trail_map, UpdateBuffer& buffer) {
+        if (Distance(state.choosen_food_position, state.position) < 5.0f) {
+            DepositPheromone(state, trail_map, buffer);
+            state.last_reached_food = state.choosen_food_position;
         }
+    }
 
-        NormalizeHeading();
-        weight_ = 0.0f;
+    template <typename Policy>
+    void Exploration(AgentState& state, const ObstacleMap& obstacles, const RandomStream& random) {
+        Vector2f new_position = CalculateNewPosition(state);
+        HandleCollisions<Policy>(state, new_position, obstacles, random);
+        if constexpr (Policy::IS_RUN) state.position = new_position;
     }
 
-    void HandleBorderCollision(sf::Vector2f& new_position) {
-        if (mode::IS_POLLING) {
-            float random_angle = ((rand() % 41) - 20);
+    Vector2f CalculateNewPosition(const AgentState& state) {
+        Vector2f new_position = state.position;
+        new_position.x += state.cos_heading * context_->speed;
+        new_position.y += state.sin_heading * context_->speed;
+        return new_position;
+    }
 
-            if (new_position.x < 0 || new_position.x >= config::WIDTH) heading_ = 180 - heading_ + random_angle;
-            else heading_ = 360 - heading_ + random_angle;
+    template <typename Policy>
+    void HandleCollisions(AgentState& state, Vector2f& new_position, const ObstacleMap& obstacles, const RandomStream& random) {
+        if constexpr (Policy::IS_MAZE) {
+            if (obstacles.IsWall(new_position)) HandleMazeCollision(state, new_position, obstacles, random);
+        }
+        if (IsBorder(new_position)) {
+            HandleBorderCollision<Policy>(state, new_position, random);
+        }
+    }
 
-            NormalizeHeading();
+    // Mirrors the heading about the wall normal taken from the distance field and pushes the
+    // agent back out of the wall along that normal.
+    void HandleMazeCollision(AgentState& state, Vector2f& new_position, const ObstacleMap& obstacles, const RandomStream& random) {
+        const size_t random_turn = random.Next(state.id, draw::MAZE_TURN) % redirect_cos_.size();
+
+        const Vector2f normal = obstacles.GetNormal(new_position);
+        if (normal == Vector2f()) {
+            new_position = state.position;
+            Redirect(state, -state.cos_heading, -state.sin_heading, random_turn);
+        }
+        else {
+            const float along_normal = state.cos_heading * normal.x + state.sin_heading * normal.y;
+            Redirect(state, state.cos_heading - 2.0f * along_normal * normal.x,
+                state.sin_heading - 2.0f * along_normal * normal.y, random_turn);
+
+            const unsigned x = static_cast<unsigned>(new_position.x);
+            const unsigned y = static_cast<unsigned>(new_position.y);
+            new_position = new_position + (1.0f - obstacles.GetDistance(x, y)) * normal;
+        }
+        state.weight = 0.0f;
+    }
+
+    template <typename Policy>
+    void HandleBorderCollision(AgentState& state, Vector2f& new_position, const RandomStream& random) {
+        if constexpr (Policy::IS_POLLING) {
+            const size_t random_turn = random.Next(state.id, draw::BORDER_TURN) % redirect_cos_.size();
+
+            if (new_position.x < 0 || new_position.x >= context_->width) Redirect(state, -state.cos_heading, state.sin_heading, random_turn);
+            else Redirect(state, state.cos_heading, -state.sin_heading, random_turn);
 
             if (new_position.x < 0) new_position.x = 1;
-            else if (new_position.x >= config::WIDTH) new_position.x = config::WIDTH - 2;
+            else if (new_position.x >= context_->width) new_position.x = context_->width - 2;
 
             if (new_position.y < 0) new_position.y = 1;
-            else if (new_position.y >= config::HEIGHT) new_position.y = config::HEIGHT - 2;
+            else if (new_position.y >= context_->height) new_position.y = context_->height - 2;
         }
         else {
-            if (new_position.x < 0) new_position.x += config::WIDTH;
-            else if (new_position.x >= config::WIDTH) new_position.x -= config::WIDTH;
+            if (new_position.x < 0) new_position.x += context_->width;
+            else if (new_position.x >= context_->width) new_position.x -= context_->width;
 
-            if (new_position.y < 0) new_position.y += config::HEIGHT;
-            else if (new_position.y >= config::HEIGHT) new_position.y -= config::HEIGHT;
+            if (new_position.y < 0) new_position.y += context_->height;
+            else if (new_position.y >= context_->height) new_position.y -= context_->height;
         }
-        weight_ = 0.0f;
+        state.weight = 0.0f;
     }
 
-    void FollowPheromoneGradient(sf::Image& trail_map, const std::vector<sf::Vector2f>& food_positions) {
-        const sf::Vector2f right_sensor_pos = position_ + RotateVector(sensor_.right);
-        const sf::Vector2f left_sensor_pos = position_ + RotateVector(sensor_.left);
-        const sf::Vector2f forward_sensor_pos = position_ + RotateVector(sensor_.forward);
+    template <typename Policy>
+    void FollowPheromoneGradient(AgentState& state, const TrailMap& trail_map, float sensor_choice) {
+        const Vector2f right_sensor_pos = state.position + RotateVector(state, sensor_.right);
+        const Vector2f left_sensor_pos = state.position + RotateVector(state, sensor_.left);
+        const Vector2f forward_sensor_pos = state.position + RotateVector(state, sensor_.forward);
 
         float r = GetSensorValue(trail_map, right_sensor_pos);
         float l = GetSensorValue(trail_map, left_sensor_pos);
         float f = GetSensorValue(trail_map, forward_sensor_pos);
 
-        float dynamic_rotation_angle = 0;
-        if (!food_positions.empty()) {
-            const float sensor_boost = (1 + weight_);
-            const float right_sensor_dst = Distance(choosen_food_position_, right_sensor_pos);
-            const float left_sensor_dst = Distance(choosen_food_position_, left_sensor_pos);
-            const float forward_sensor_dst = Distance(choosen_food_position_, forward_sensor_pos);
-
-            if (right_sensor_dst < left_sensor_dst && right_sensor_dst < forward_sensor_dst) r += sensor_boost * sensor::BOOST;
-            else if (left_sensor_dst < right_sensor_dst && left_sensor_dst < forward_sensor_dst) l += sensor_boost * sensor::BOOST;
-            else if (forward_sensor_dst < left_sensor_dst && forward_sensor_dst < right_sensor_dst) f += sensor_boost * sensor::BOOST;
-            dynamic_rotation_angle = CalculateDynamicRotationAngle(Distance(position_, choosen_food_position_));
+        if constexpr (Policy::HAS_FOOD) {
+            const float sensor_boost = (1 + state.weight);
+            const float right_sensor_dst = Distance(state.choosen_food_position, right_sensor_pos);
+            const float left_sensor_dst = Distance(state.choosen_food_position, left_sensor_pos);
+            const float forward_sensor_dst = Distance(state.choosen_food_position, forward_sensor_pos);
+
+            if (right_sensor_dst < left_sensor_dst && right_sensor_dst < forward_sensor_dst) r += sensor_boost * context_->sensor_boost;
+            else if (left_sensor_dst < right_sensor_dst && left_sensor_dst < forward_sensor_dst) l += sensor_boost * context_->sensor_boost;
+            else if (forward_sensor_dst < left_sensor_dst && forward_sensor_dst < right_sensor_dst) f += sensor_boost * context_->sensor_boost;
         }
 
-        float max_val = std::max({ r, l, f });
         float sum = r + l + f;
 
         if (sum == 0) return;
 
-        float rand_val = static_cast<float>(rand()) / RAND_MAX;
-        if (rand_val < (r / sum)) heading_ += agent::ROTATION_ANGLE + dynamic_rotation_angle;
-        else if (rand_val < ((r + l) / sum)) heading_ -= agent::ROTATION_ANGLE + dynamic_rotation_angle;
+        if (sensor_choice < (r / sum)) state.turn = 1;
+        else if (sensor_choice < ((r + l) / sum)) state.turn = -1;
     }
 
-    void DepositPheromone(sf::Image& trail_map) {
-        sf::Color color = trail_map.getPixel(position_.x, position_.y);
-        color.r = std::min(255, color.r + 50);
-        trail_map.setPixel(position_.x, position_.y, color);
+    // The heading vector for the next step: a turn rotates the vector by the precomputed
+    // turn and pulls it back to unit length.
+    template <typename Policy>
+    void UpdateDirection(AgentState& state) {
+        if (state.turn == 0) return;
+
+        float cos_turn = turn_cos_;
+        float sin_turn = turn_sin_;
+        if constexpr (Policy::HAS_FOOD) {
+            const float step = state.weight * (FOOD_TURN_STEPS / FOOD_TURN_MAX_WEIGHT);
+            if (step >= 0.0f && step <= FOOD_TURN_STEPS) {
+                const size_t k = static_cast<size_t>(step + 0.5f);
+                const float rest = (static_cast<float>(k) - step) * food_turn_per_step_;
+                const float cos_rest = 1.0f - 0.5f * rest * rest;
+                cos_turn = food_turn_cos_[k] * cos_rest - food_turn_sin_[k] * rest;
+                sin_turn = food_turn_sin_[k] * cos_rest + food_turn_cos_[k] * rest;
+            }
+            else {
+                const float rad = (context_->rotation_angle + CalculateDynamicRotationAngle(state, 0.0f)) * constant::PI / 180.0f;
+                cos_turn = cosf(rad);
+                sin_turn = sinf(rad);
+            }
+        }
+
+        sin_turn *= state.turn;
+        const float x = state.cos_heading * cos_turn - state.sin_heading * sin_turn;
+        const float y = state.cos_heading * sin_turn + state.sin_heading * cos_turn;
+        const float scale = 1.5f - 0.5f * (x * x + y * y);
+        state.cos_heading = x * scale;
+        state.sin_heading = y * scale;
     }
 
-    sf::Vector2f GetRandomAgentPosition() {
-        return population_[rand() % population_.size()]->position_;
+    // Heads the agent along (x, y), turned by the table entry `turn`.
+    void Redirect(AgentState& state, float x, float y, size_t turn) {
+        const float length = std::sqrt(x * x + y * y);
+        x /= length;
+        y /= length;
+        state.cos_heading = x * redirect_cos_[turn] - y * redirect_sin_[turn];
+        state.sin_heading = x * redirect_sin_[turn] + y * redirect_cos_[turn];
     }
 
-    sf::Vector2f RotateVector(const sf::Vector2f& vec) {
+    void DepositPheromone(const AgentState& state, const TrailMap& trail_map, UpdateBuffer& buffer) {
+        if (state.position.x < 0 || state.position.y < 0) return;
+
+        const unsigned x = static_cast<unsigned>(state.position.x);
+        const unsigned y = static_cast<unsigned>(state.position.y);
+        if (x < trail_map.GetWidth() && y < trail_map.GetHeight()) {
+            buffer.deposits.push_back(y * trail_map.GetWidth() + x);
+        }
+    }
+
+    Vector2f GetRandomAgentPosition(uint32_t random) {
+        if (partners_) return (*partners_)[random % partners_->size()];
+        const size_t i = random % x_.size();
+        return { x_[i], y_[i] };
+    }
+
+    Vector2f RotateVector(const AgentState& state, const Vector2f& vec) {
         return {
-            vec.x * cos_heading_ - vec.y * sin_heading_,
-            vec.x * sin_heading_ + vec.y * cos_heading_
+            vec.x * state.cos_heading - vec.y * state.sin_heading,
+            vec.x * state.sin_heading + vec.y * state.cos_heading
         };
     }
 
     void PrecomputeSensorVectors() {
-        const float radian_angle = sensor::ANGLE * constant::PI / 180.0f;
+        const float radian_angle = context_->sensor_angle * constant::PI / 180.0f;
         sensor_.right = {
-            sensor::DISTANCE * cosf(radian_angle),
-            sensor::DISTANCE * sinf(radian_angle)
+            context_->sensor_distance * cosf(radian_angle),
+            context_->sensor_distance * sinf(radian_angle)
         };
         sensor_.left = {
-            sensor::DISTANCE * cosf(-radian_angle),
-            sensor::DISTANCE * sinf(-radian_angle)
+            context_->sensor_distance * cosf(-radian_angle),
+            context_->sensor_distance * sinf(-radian_angle)
         };
-        sensor_.forward = { sensor::DISTANCE, 0.0f };
+        sensor_.forward = { context_->sensor_distance, 0.0f };
     }
 
-    void UpdateCosSin() {
-        const float rad = heading_ * constant::PI / 180.0f;
-        cos_heading_ = cosf(rad);
-        sin_heading_ = sinf(rad);
-    }
-
-    float GetSensorValue(const sf::Image& trail_map, const sf::Vector2f& sensor_position) {
-        const unsigned x = static_cast<unsigned>(std::clamp(sensor_position.x, 0.0f, static_cast<float>(config::WIDTH - 1)));
-        const unsigned y = static_cast<unsigned>(std::clamp(sensor_position.y, 0.0f, static_cast<float>(config::HEIGHT - 1)));
+    void PrecomputeTurn() {
+        const float radian_angle = context_->rotation_angle * constant::PI / 180.0f;
+        turn_cos_ = cosf(radian_angle);
+        turn_sin_ = sinf(radian_angle);
+
+        for (size_t k = 0; k <= FOOD_TURN_STEPS; ++k) {
+            AgentState state{};
+            state.weight = k * (FOOD_TURN_MAX_WEIGHT / FOOD_TURN_STEPS);
+            const float rad = (context_->rotation_angle + CalculateDynamicRotationAngle(state, 0.0f)) * constant::PI / 180.0f;
+            food_turn_cos_[k] = cosf(rad);
+            food_turn_sin_[k] = sinf(rad);
+        }
+        food_turn_per_step_ = context_->rotation_angle / 3.0f * context_->angle_responsiveness
+            * (FOOD_TURN_MAX_WEIGHT / FOOD_TURN_STEPS) * constant::PI / 180.0f;
 
-        sf::Color color = trail_map.getPixel(x, y);
-        return (color.r + color.g + color.b) / 3.0f;
+        for (size_t k = 0; k < redirect_cos_.size(); ++k) {
+            const float rad = (static_cast<int>(k) - REDIRECT_SPREAD) * constant::PI / 180.0f;
+            redirect_cos_[k] = cosf(rad);
+            redirect_sin_[k] = sinf(rad);
+        }
     }
 
-    float CalculateDirection(sf::Vector2f target_pos) {
-        const float delta_x = target_pos.x - position_.x;
-        const float delta_y = target_pos.y - position_.y;
-        const float angle_rad = std::atan2(delta_y, delta_x);
-
-        float angle_deg = angle_rad * 180.0f / static_cast<float>(constant::PI);
-        return std::fmod(angle_deg + 360.0f, 360.0f);
-    }
+    float GetSensorValue(const TrailMap& trail_map, const Vector2f& sensor_position) {
+        const unsigned x = static_cast<unsigned>(std::clamp(sensor_position.x, 0.0f, static_cast<float>(context_->width - 1)));
+        const unsigned y = static_cast<unsigned>(std::clamp(sensor_position.y, 0.0f, static_cast<float>(context_->height - 1)));
 
-    float CalculateDynamicRotationAngle(float distance_to_food) {
-        return agent::ROTATION_ANGLE / 3.0f * (1.0f + simulation::ANGLE_RESPONSIVNESS * (1.0f - weight_));
+        return trail_map.GetValue(x, y);
     }
 
-    sf::Vector2f FindGlobalBestFood(const std::vector<sf::Vector2f>& food) {
-        float min_dist = INFINITY;
-        sf::Vector2f best;
-        for (const auto& f : food) {
-            if (f == last_reached_food_) continue;
-
-            float d = Distance(position_, f);
-            if (d < min_dist) {
-                min_dist = d;
-                best = f;
-            }
-        }
-
-        if (best == sf::Vector2f() && !food.empty()) {
-            last_reached_food_ = sf::Vector2f();
-            return FindGlobalBestFood(food);
-        }
-
-        return best;
+    float CalculateDynamicRotationAngle(const AgentState& state, float distance_to_food) {
+        return context_->rotation_angle / 3.0f * (1.0f + context_->angle_responsiveness * (1.0f - state.weight));
     }
-    bool IsWallCollision(const sf::Vector2f& position) const {
-        int cell_x = static_cast<int>(position.x / maze::CELL_SIZE);
-        int cell_y = static_cast<int>(position.y / maze::CELL_SIZE);
 
-        if (cell_x <= 0 || cell_x >= maze::MAZE[0].size() || cell_y <= 0 || cell_y >= maze::MAZE.size()) return true;
-
-        return maze::MAZE[cell_y][cell_x] == 1;
+    // Nearest food other than the one the agent last reached, unless it is the only one.
+    static Vector2f SelectBestFood(const FoodMap& food_map, const FoodMap::Entry& food, const Vector2f& last_reached_food) {
+        const Vector2f& nearest = food_map.GetFood(food.nearest);
+        if (nearest != last_reached_food || food.second == FoodMap::NONE) return nearest;
+        return food_map.GetFood(food.second);
     }
 
-    bool IsBorder(sf::Vector2f position) {
-        return position.x < 0 || position.x >= config::WIDTH || position.y < 0 || position.y >= config::HEIGHT;
+    Vector2f FindGlobalBestFood(AgentState& state, const FoodMap& food_map, const FoodMap::Entry& food) {
+        const Vector2f best = SelectBestFood(food_map, food, state.last_reached_food);
+        if (best == state.last_reached_food) state.last_reached_food = Vector2f();
+        return best;
     }
 
-    void NormalizeHeading() {
-        if (heading_ < 0) heading_ += 360;
-        else if (heading_ >= 360) heading_ -= 360;
+    bool IsBorder(Vector2f position) {
+        return position.x < 0 || position.x >= context_->width || position.y < 0 || position.y >= context_->height;
     }
-};
\ No newline at end of file
+};
@@ -0,0 +1,110 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+// Counts heap allocations while armed, to check that a loop has reached its steady state,
+// where every buffer is reused and nothing reaches the allocator. It replaces the global
+// operator new and delete, plain, aligned and nothrow, so only an executable's own
+// translation unit may include it.
+namespace allocation {
+    std::atomic<bool> IS_COUNTING{ false };
+    std::atomic<unsigned long long> COUNT{ 0 };
+    thread_local unsigned PAUSE_DEPTH = 0;
+
+    void Start() {
+        COUNT.store(0, std::memory_order_relaxed);
+        IS_COUNTING.store(true, std::memory_order_release);
+    }
+
+    // Allocations since Start().
+    unsigned long long Stop() {
+        IS_COUNTING.store(false, std::memory_order_release);
+        return COUNT.load(std::memory_order_relaxed);
+    }
+
+    unsigned long long Peek() { return COUNT.load(std::memory_order_relaxed); }
+
+    // Leaves the calling thread's allocations out of the count for its lifetime; for work
+    // that is allowed to allocate, such as formatting overlay text a few times a second.
+    class Pause {
+    public:
+        Pause() { ++PAUSE_DEPTH; }
+        ~Pause() { --PAUSE_DEPTH; }
+        Pause(const Pause&) = delete;
+        Pause& operator=(const Pause&) = delete;
+    };
+
+    void* Allocate(std::size_t size) noexcept {
+        if (IS_COUNTING.load(std::memory_order_relaxed) && PAUSE_DEPTH == 0) COUNT.fetch_add(1, std::memory_order_relaxed);
+        return std::malloc(size != 0 ? size : 1);
+    }
+
+    void* AllocateAligned(std::size_t size, std::align_val_t alignment) noexcept {
+        if (IS_COUNTING.load(std::memory_order_relaxed) && PAUSE_DEPTH == 0) COUNT.fetch_add(1, std::memory_order_relaxed);
+        const std::size_t align = std::max(static_cast<std::size_t>(alignment), sizeof(void*));
+#if defined(_WIN32)
+        return _aligned_malloc(size != 0 ? size : 1, align);
+#else
+        // aligned_alloc wants a whole number of alignments.
+        return std::aligned_alloc(align, std::max<std::size_t>(1, (size + align - 1) / align) * align);
+#endif
+    }
+
+    // Out of line, since GCC warns of a mismatch once it inlines free() next to the new
+    // expression that allocated the pointer.
+#if defined(__GNUC__)
+    __attribute__((noinline))
+#endif
+    void Release(void* pointer) noexcept { std::free(pointer); }
+
+#if defined(__GNUC__)
+    __attribute__((noinline))
+#endif
+    void ReleaseAligned(void* pointer) noexcept {
+#if defined(_WIN32)
+        _aligned_free(pointer);
+#else
+        std::free(pointer);
+#endif
+    }
+}
+
+void* operator new(std::size_t size) {
+    if (void* pointer = allocation::Allocate(size)) return pointer;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    if (void* pointer = allocation::AllocateAligned(size, alignment)) return pointer;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) { return operator new(size); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return operator new(size, alignment); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return allocation::Allocate(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return allocation::Allocate(size); }
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocation::AllocateAligned(size, alignment);
+}
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocation::AllocateAligned(size, alignment);
+}
+
+void operator delete(void* pointer) noexcept { allocation::Release(pointer); }
+void operator delete[](void* pointer) noexcept { allocation::Release(pointer); }
+void operator delete(void* pointer, std::size_t) noexcept { allocation::Release(pointer); }
+void operator delete[](void* pointer, std::size_t) noexcept { allocation::Release(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { allocation::Release(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { allocation::Release(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept { allocation::ReleaseAligned(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { allocation::ReleaseAligned(pointer); }
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept { allocation::ReleaseAligned(pointer); }
+void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept { allocation::ReleaseAligned(pointer); }
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { allocation::ReleaseAligned(pointer); }
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { allocation::ReleaseAligned(pointer); }
+
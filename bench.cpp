@@ -0,0 +1,234 @@
+#include "domain.h"
+#include "framework.h"
+#include "engine.h"
+
+#include <chrono>
+
+// One measured benchmark. `items` is what a single iteration processes (agents, pixels
+// or queries), so items_per_second can be compared across frame sizes.
+struct BenchResult {
+    std::string name;
+    std::string frame;
+    unsigned food = 0;
+    size_t items = 0;
+    unsigned long long iterations = 0;
+    double seconds = 0.0;
+};
+
+const char* FrameName(frame::Size size) {
+    switch (size) {
+    case frame::MINI: return "mini";
+    case frame::SMALL: return "small";
+    case frame::MEDIUM: return "medium";
+    case frame::BIG: return "big";
+    }
+    return "";
+}
+
+const char* SimdName() {
+#if defined(SLIME_SIMD_AVX2)
+    return "avx2";
+#elif defined(SLIME_SIMD_SSE2)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+class BenchRunner {
+public:
+    explicit BenchRunner(const Settings& settings) : settings_(settings) {}
+
+    bool IsSelected(const std::string& label) const {
+        return settings_.filter.empty() || label.find(settings_.filter) != std::string::npos;
+    }
+
+    // Runs body() once to warm up, then repeats it until --min-time has passed.
+    template <typename Body>
+    void Run(const std::string& name, frame::Size size, unsigned food, size_t items, const Body& body) {
+        const std::string label = Label(name, size, food);
+        if (!IsSelected(label)) return;
+
+        body();
+        BenchResult result{ name, FrameName(size), food, items };
+        const auto start = std::chrono::steady_clock::now();
+        do {
+            body();
+            ++result.iterations;
+            result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        } while (result.seconds < settings_.min_time);
+
+        std::cerr << label << ": " << result.seconds / result.iterations * 1e3 << " ms/iter, "
+            << result.items * result.iterations / result.seconds << " items/sec\n";
+        results_.push_back(result);
+    }
+
+    static std::string Label(const std::string& name, frame::Size size, unsigned food) {
+        return name + "/" + FrameName(size) + "/" + std::to_string(food);
+    }
+
+    void WriteJson(std::ostream& output, unsigned threads) const {
+        output << "{\n"
+            << "  \"version\": 1,\n"
+            << "  \"seed\": " << settings_.seed << ",\n"
+            << "  \"threads\": " << threads << ",\n"
+            << "  \"simd\": \"" << SimdName() << "\",\n"
+            << "  \"min_time\": " << settings_.min_time << ",\n"
+            << "  \"results\": [";
+        for (size_t i = 0; i < results_.size(); ++i) {
+            const BenchResult& result = results_[i];
+            output << (i == 0 ? "\n" : ",\n")
+                << "    { \"name\": \"" << result.name << "\""
+                << ", \"frame\": \"" << result.frame << "\""
+                << ", \"food\": " << result.food
+                << ", \"items\": " << result.items
+                << ", \"iterations\": " << result.iterations
+                << ", \"seconds_per_iteration\": " << result.seconds / result.iterations
+                << ", \"items_per_second\": " << result.items * result.iterations / result.seconds << " }";
+        }
+        output << "\n  ]\n}\n";
+    }
+
+private:
+    Settings settings_;
+    std::vector<BenchResult> results_;
+};
+
+std::vector<Vector2f> RandomFood(unsigned count, const SimulationContext& context, const RandomStream& random) {
+    std::vector<Vector2f> food;
+    for (unsigned i = 0; i < count; ++i) {
+        food.push_back({
+            static_cast<float>(random.Next(i, draw::FOOD_X) % context.width),
+            static_cast<float>(random.Next(i, draw::FOOD_Y) % context.height)
+            });
+    }
+    return food;
+}
+
+// Every simulation phase on its own, at the frame chosen with --frame.
+void RunMicrobenchmarks(BenchRunner& runner, Settings settings, ThreadPool& pool) {
+    const SimulationContext context = MakeContext(settings);
+    const frame::Size size = settings.frame;
+    const RandomStream random(settings.seed, 0);
+    const size_t pixels = static_cast<size_t>(context.width) * context.height;
+
+    TrailMap trail_map(context.width, context.height);
+    for (size_t i = 0; i < pixels; ++i) {
+        trail_map.AddValue(i, random.Uniform(i, draw::SENSOR_CHOICE) * simulation::TRAIL_MAX);
+    }
+
+    runner.Run("decay", size, 0, pixels, [&] {
+        trail_map.Diffuse(simulation::DECAY_RATE, 0.0f, diffusion::GAUSSIAN, pool);
+        });
+    runner.Run("blur_gaussian", size, 0, pixels, [&] {
+        trail_map.Diffuse(simulation::DECAY_RATE, 1.0f, diffusion::GAUSSIAN, pool);
+        });
+    runner.Run("blur_box", size, 0, pixels, [&] {
+        trail_map.Diffuse(simulation::DECAY_RATE, 1.0f, diffusion::BOX, pool);
+        });
+
+    ObstacleMap obstacles;
+    obstacles.BuildBuiltIn(context.width, context.height, pool);
+    AgentPool agents(context.num_agents, random, context);
+    const size_t count = agents.Size();
+
+    runner.Run("maze_collision", size, 0, count, [&] {
+        pool.ParallelFor(count, simulation::AGENTS_PER_TASK, [&](size_t begin, size_t end) {
+            Vector2f normal_sum;
+            for (size_t i = begin; i < end; ++i) {
+                const Vector2f position = agents.GetPos(i);
+                if (obstacles.IsWall(position)) normal_sum = normal_sum + obstacles.GetNormal(position);
+            }
+            volatile float sink = normal_sum.x + normal_sum.y;
+            (void)sink;
+            });
+        });
+
+    const size_t task_count = (count + simulation::AGENTS_PER_TASK - 1) / simulation::AGENTS_PER_TASK;
+    std::vector<UpdateBuffer> buffers(task_count);
+    const auto for_each_task = [&](const auto& body) {
+        pool.Run(task_count, [&](size_t task) {
+            const size_t begin = task * simulation::AGENTS_PER_TASK;
+            body(begin, std::min(count, begin + simulation::AGENTS_PER_TASK), buffers[task]);
+            });
+    };
+
+    for (unsigned food_count : { 10u, 1000u }) {
+        FoodMap food_map;
+        const std::vector<Vector2f> food = RandomFood(food_count, context, random);
+        runner.Run("food_map_rebuild", size, food_count, pixels, [&] {
+            food_map.Rebuild(food, context.width, context.height, pool);
+            });
+        food_map.Rebuild(food, context.width, context.height, pool);
+
+        // What each agent asks about food every step: nearest source, fitness and weight.
+        const FitnessRange range = { 0.0f, std::hypot(static_cast<float>(context.width), static_cast<float>(context.height)) };
+        runner.Run("food_query", size, food_count, count, [&] {
+            pool.ParallelFor(count, simulation::AGENTS_PER_TASK, [&](size_t begin, size_t end) {
+                float weight_sum = 0.0f;
+                for (size_t i = begin; i < end; ++i) {
+                    const Vector2f position = agents.GetPos(i);
+                    const FoodMap::Entry entry = food_map.Lookup(position);
+                    const float fitness = FitnessFunc(position, food_map.GetFood(entry.nearest));
+                    weight_sum += CalculateAgentWeight(fitness, range, 0.5f);
+                }
+                volatile float sink = weight_sum;
+                (void)sink;
+                });
+            });
+
+        runner.Run("agent_evaluate", size, food_count, count, [&] {
+            for_each_task([&](size_t begin, size_t end, UpdateBuffer& buffer) {
+                buffer.Reset();
+                agents.Evaluate(begin, end, food_map, buffer);
+                });
+            });
+
+        runner.Run("agent_move", size, food_count, count, [&] {
+            const RandomStream step_random(settings.seed, 1);
+            for_each_task([&](size_t begin, size_t end, UpdateBuffer& buffer) {
+                agents.Move(begin, end, trail_map, food_map, obstacles, range, step_random, buffer);
+                });
+            agents.SwapPositions();
+            });
+    }
+}
+
+// Whole steps through the engine for every frame preset and food count.
+void RunStepBenchmarks(BenchRunner& runner, Settings settings) {
+    for (frame::Size size : { frame::MINI, frame::SMALL, frame::MEDIUM, frame::BIG }) {
+        for (unsigned food_count : { 0u, 10u, 1000u }) {
+            if (!runner.IsSelected(BenchRunner::Label("step", size, food_count))) continue;
+
+            settings.frame = size;
+            settings.width = settings.height = settings.num_agents = 0;
+            settings.food_count = food_count;
+            Engine engine(settings);
+            runner.Run("step", size, food_count, engine.GetContext().num_agents, [&] { engine.Step(); });
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    Settings settings;
+    if (!ParseSettings(argc, argv, settings)) return EXIT_FAILURE;
+    if (settings.seed == 0) settings.seed = 1;
+
+    BenchRunner runner(settings);
+    ThreadPool pool(settings.threads);
+    RunMicrobenchmarks(runner, settings, pool);
+    RunStepBenchmarks(runner, settings);
+
+    if (settings.output.empty()) {
+        runner.WriteJson(std::cout, pool.GetThreadCount());
+    }
+    else {
+        std::ofstream output(settings.output);
+        if (!output) {
+            std::cerr << "Error writing '" << settings.output << "'\n";
+            return EXIT_FAILURE;
+        }
+        runner.WriteJson(output, pool.GetThreadCount());
+    }
+    return 0;
+}
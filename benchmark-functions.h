@@ -0,0 +1,154 @@
+#pragma once
+#include "domain.h"
+#include "parallel.h"
+
+#include <array>
+
+// Noiseless test functions from the BBOB and CEC suites, each with its minimum of 0 moved to
+// a random x_opt. The shift matters for SMA: its vc term contracts agents towards the
+// origin, which is exactly where the unshifted minima sit. Sums are taken in double so
+// targets down to 1e-8 are not lost to cancellation.
+namespace benchmark {
+    const float LOWER = -5.0f;
+    const float UPPER = 5.0f;
+    const float SHIFT_RANGE = 4.0f;
+    const size_t POINTS_PER_TASK = 64;
+
+    template <size_t Dim>
+    using Point = std::array<float, Dim>;
+
+    template <size_t Dim>
+    float Sphere(const Point<Dim>& z) {
+        double sum = 0.0;
+        for (size_t j = 0; j < Dim; ++j) sum += static_cast<double>(z[j]) * z[j];
+        return static_cast<float>(sum);
+    }
+
+    template <size_t Dim>
+    float Ellipsoid(const Point<Dim>& z) {
+        static const std::array<double, Dim> scales = [] {
+            std::array<double, Dim> result;
+            for (size_t j = 0; j < Dim; ++j) result[j] = std::pow(1e6, Dim > 1 ? j / static_cast<double>(Dim - 1) : 0.0);
+            return result;
+        }();
+        double sum = 0.0;
+        for (size_t j = 0; j < Dim; ++j) sum += scales[j] * z[j] * z[j];
+        return static_cast<float>(sum);
+    }
+
+    template <size_t Dim>
+    float BentCigar(const Point<Dim>& z) {
+        double sum = 0.0;
+        for (size_t j = 1; j < Dim; ++j) sum += static_cast<double>(z[j]) * z[j];
+        return static_cast<float>(static_cast<double>(z[0]) * z[0] + 1e6 * sum);
+    }
+
+    template <size_t Dim>
+    float Discus(const Point<Dim>& z) {
+        double sum = 0.0;
+        for (size_t j = 1; j < Dim; ++j) sum += static_cast<double>(z[j]) * z[j];
+        return static_cast<float>(1e6 * z[0] * z[0] + sum);
+    }
+
+    // Minimum at z = 0 rather than at z = 1, so the shift alone places it.
+    template <size_t Dim>
+    float Rosenbrock(const Point<Dim>& z) {
+        double sum = 0.0;
+        for (size_t j = 0; j + 1 < Dim; ++j) {
+            const double x = z[j] + 1.0;
+            const double next = z[j + 1] + 1.0;
+            sum += 100.0 * (x * x - next) * (x * x - next) + (x - 1.0) * (x - 1.0);
+        }
+        return static_cast<float>(sum);
+    }
+
+    template <size_t Dim>
+    float Rastrigin(const Point<Dim>& z) {
+        double sum = 10.0 * Dim;
+        for (size_t j = 0; j < Dim; ++j) sum += static_cast<double>(z[j]) * z[j] - 10.0 * std::cos(2.0 * constant::PI * z[j]);
+        return static_cast<float>(sum);
+    }
+
+    template <size_t Dim>
+    float Ackley(const Point<Dim>& z) {
+        double squares = 0.0;
+        double cosines = 0.0;
+        for (size_t j = 0; j < Dim; ++j) {
+            squares += static_cast<double>(z[j]) * z[j];
+            cosines += std::cos(2.0 * constant::PI * z[j]);
+        }
+        const double value = -20.0 * std::exp(-0.2 * std::sqrt(squares / Dim)) - std::exp(cosines / Dim) + 20.0 + std::exp(1.0);
+        return static_cast<float>(std::max(value, 0.0));
+    }
+
+    template <size_t Dim>
+    float Griewank(const Point<Dim>& z) {
+        double sum = 0.0;
+        double product = 1.0;
+        for (size_t j = 0; j < Dim; ++j) {
+            sum += static_cast<double>(z[j]) * z[j];
+            product *= std::cos(z[j] / std::sqrt(j + 1.0));
+        }
+        return static_cast<float>(std::max(sum / 4000.0 - product + 1.0, 0.0));
+    }
+
+    template <size_t Dim>
+    using BatchFunction = void (*)(const Point<Dim>* points, size_t count, const Point<Dim>& shift, float* fitness);
+
+    // One indirect call per batch; the function itself is inlined into the loop.
+    template <size_t Dim, float (*Function)(const Point<Dim>&)>
+    void EvaluateShifted(const Point<Dim>* points, size_t count, const Point<Dim>& shift, float* fitness) {
+        for (size_t i = 0; i < count; ++i) {
+            Point<Dim> z;
+            for (size_t j = 0; j < Dim; ++j) z[j] = points[i][j] - shift[j];
+            fitness[i] = Function(z);
+        }
+    }
+
+    template <size_t Dim>
+    struct Function {
+        const char* name;
+        const char* origin;
+        BatchFunction<Dim> evaluate;
+    };
+
+    template <size_t Dim>
+    const std::vector<Function<Dim>>& GetFunctions() {
+        static const std::vector<Function<Dim>> functions = {
+            { "sphere", "BBOB f1", EvaluateShifted<Dim, Sphere<Dim>> },
+            { "ellipsoid", "BBOB f2", EvaluateShifted<Dim, Ellipsoid<Dim>> },
+            { "rastrigin", "BBOB f3", EvaluateShifted<Dim, Rastrigin<Dim>> },
+            { "rosenbrock", "BBOB f8", EvaluateShifted<Dim, Rosenbrock<Dim>> },
+            { "discus", "BBOB f11", EvaluateShifted<Dim, Discus<Dim>> },
+            { "bent-cigar", "BBOB f12, CEC 2017 F1", EvaluateShifted<Dim, BentCigar<Dim>> },
+            { "ackley", "CEC 2014 F5", EvaluateShifted<Dim, Ackley<Dim>> },
+            { "griewank", "CEC 2014 F7", EvaluateShifted<Dim, Griewank<Dim>> },
+        };
+        return functions;
+    }
+
+    // A function with its x_opt drawn from the seed, evaluated over the batch in parallel
+    // tasks of POINTS_PER_TASK points.
+    template <size_t Dim>
+    class Objective {
+    public:
+        Objective(const Function<Dim>& function, uint64_t seed, ThreadPool& pool)
+            : evaluate_(function.evaluate), pool_(&pool) {
+            const RandomStream random(seed, 0);
+            for (size_t j = 0; j < Dim; ++j) shift_[j] = (random.Uniform(j, draw::OPT_SHIFT) * 2.0f - 1.0f) * SHIFT_RANGE;
+        }
+
+        void operator()(const Point<Dim>* points, size_t count, float* fitness) const {
+            pool_->ParallelFor(count, POINTS_PER_TASK, [&](size_t begin, size_t end) {
+                evaluate_(points + begin, end - begin, shift_, fitness + begin);
+                });
+        }
+
+        const Point<Dim>& GetOptimum() const { return shift_; }
+
+    private:
+        BatchFunction<Dim> evaluate_;
+        ThreadPool* pool_;
+        Point<Dim> shift_;
+    };
+}
@@ -0,0 +1,236 @@
+#pragma once
+#include "domain.h"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+// Processes of one machine joined by a full mesh of Unix socket pairs. Launch forks the
+// other ranks off the calling process, which becomes rank 0; every rank must then make the
+// same collective calls in the same order. Messages are framed by their length and all
+// transfers of a call progress together under poll(), so two ranks sending each other
+// more than a socket buffer do not deadlock. A transport error is fatal: a rank that lost
+// a peer cannot stay in step with the others.
+class Communicator {
+public:
+    Communicator(const Communicator&) = delete;
+    Communicator& operator=(const Communicator&) = delete;
+
+    Communicator(Communicator&& other) noexcept
+        : rank_(other.rank_), size_(other.size_), sockets_(std::move(other.sockets_)), children_(std::move(other.children_)) {
+        other.sockets_.clear();
+        other.children_.clear();
+    }
+
+    ~Communicator() {
+        for (int socket : sockets_) {
+            if (socket >= 0) close(socket);
+        }
+    }
+
+    // Returns in every rank. Threads do not survive fork, so start them afterwards.
+    static Communicator Launch(unsigned size) {
+        std::vector<std::vector<int>> sockets(size, std::vector<int>(size, -1));
+        for (unsigned a = 0; a < size; ++a) {
+            for (unsigned b = a + 1; b < size; ++b) {
+                int pair[2];
+                if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) Fail("socketpair");
+                sockets[a][b] = pair[0];
+                sockets[b][a] = pair[1];
+            }
+        }
+
+        std::cout.flush();
+        std::cerr.flush();
+        unsigned rank = 0;
+        std::vector<pid_t> children;
+        for (unsigned r = 1; r < size; ++r) {
+            const pid_t pid = fork();
+            if (pid < 0) Fail("fork");
+            if (pid == 0) {
+                rank = r;
+                children.clear();
+                break;
+            }
+            children.push_back(pid);
+        }
+
+        Communicator communicator(rank, size);
+        communicator.children_ = std::move(children);
+        for (unsigned a = 0; a < size; ++a) {
+            for (unsigned b = 0; b < size; ++b) {
+                if (sockets[a][b] < 0) continue;
+                if (a == rank) communicator.sockets_[b] = sockets[a][b];
+                else close(sockets[a][b]);
+            }
+        }
+        for (int socket : communicator.sockets_) {
+            if (socket >= 0) fcntl(socket, F_SETFL, fcntl(socket, F_GETFL) | O_NONBLOCK);
+        }
+        return communicator;
+    }
+
+    unsigned GetRank() const { return rank_; }
+    unsigned GetSize() const { return size_; }
+
+    // Ends a rank. Other ranks exit with `status`; rank 0 waits for them and returns
+    // `status`, or EXIT_FAILURE if one of them failed.
+    int Finish(int status) {
+        for (int& socket : sockets_) {
+            if (socket >= 0) close(socket);
+            socket = -1;
+        }
+        if (rank_ != 0) {
+            std::cout.flush();
+            std::cerr.flush();
+            _exit(status);
+        }
+        for (pid_t child : children_) {
+            int child_status = 0;
+            if (waitpid(child, &child_status, 0) < 0 || !WIFEXITED(child_status) || WEXITSTATUS(child_status) != 0) {
+                status = EXIT_FAILURE;
+            }
+        }
+        children_.clear();
+        return status;
+    }
+
+    // outgoing[r] goes to rank r and incoming[r] is what rank r sent here; the rank's own
+    // entry is moved across. outgoing is left empty.
+    void AllToAll(std::vector<std::vector<uint8_t>>& outgoing, std::vector<std::vector<uint8_t>>& incoming) {
+        incoming.resize(size_);
+        incoming[rank_].swap(outgoing[rank_]);
+        outgoing[rank_].clear();
+
+        std::vector<Transfer> sends(size_), receives(size_);
+        std::vector<pollfd> polls;
+        for (unsigned peer = 0; peer < size_; ++peer) {
+            if (peer == rank_) continue;
+            sends[peer].length = outgoing[peer].size();
+            incoming[peer].clear();
+        }
+
+        for (;;) {
+            polls.clear();
+            std::vector<unsigned> peers;
+            for (unsigned peer = 0; peer < size_; ++peer) {
+                if (peer == rank_) continue;
+                const short events = (sends[peer].IsDone() ? 0 : POLLOUT) | (receives[peer].IsDone() ? 0 : POLLIN);
+                if (events == 0) continue;
+                polls.push_back({ sockets_[peer], events, 0 });
+                peers.push_back(peer);
+            }
+            if (polls.empty()) break;
+
+            if (poll(polls.data(), polls.size(), -1) < 0) {
+                if (errno == EINTR) continue;
+                Fail("poll");
+            }
+            for (size_t p = 0; p < polls.size(); ++p) {
+                const unsigned peer = peers[p];
+                if (polls[p].revents & POLLOUT) Send(peer, sends[peer], outgoing[peer]);
+                if (polls[p].revents & (POLLIN | POLLHUP | POLLERR)) Receive(peer, receives[peer], incoming[peer]);
+            }
+        }
+        for (auto& message : outgoing) message.clear();
+    }
+
+    // values[r] is rank r's value, in every rank.
+    void AllGather(const std::vector<uint8_t>& value, std::vector<std::vector<uint8_t>>& values) {
+        std::vector<std::vector<uint8_t>> outgoing(size_, value);
+        AllToAll(outgoing, values);
+    }
+
+    // values[r] is rank r's value in rank 0; other ranks get nothing back.
+    void Gather(const std::vector<uint8_t>& value, std::vector<std::vector<uint8_t>>& values) {
+        std::vector<std::vector<uint8_t>> outgoing(size_);
+        outgoing[0] = value;
+        AllToAll(outgoing, values);
+    }
+
+    template <typename T>
+    void AllGatherValue(const T& value, std::vector<T>& values) {
+        static_assert(std::is_trivially_copyable<T>::value, "values are sent as bytes");
+        std::vector<uint8_t> bytes(sizeof(T));
+        std::memcpy(bytes.data(), &value, sizeof(T));
+        std::vector<std::vector<uint8_t>> gathered;
+        AllGather(bytes, gathered);
+        values.resize(size_);
+        for (unsigned r = 0; r < size_; ++r) std::memcpy(&values[r], gathered[r].data(), sizeof(T));
+    }
+
+    void Barrier() {
+        std::vector<std::vector<uint8_t>> values;
+        AllGather({}, values);
+    }
+
+private:
+    // One framed message: an 8-byte length, then the payload.
+    struct Transfer {
+        uint64_t length = 0;
+        size_t header_done = 0;
+        size_t payload_done = 0;
+
+        bool IsDone() const { return header_done == sizeof(length) && payload_done == length; }
+    };
+
+    unsigned rank_ = 0;
+    unsigned size_ = 1;
+    std::vector<int> sockets_;
+    std::vector<pid_t> children_;
+
+    Communicator(unsigned rank, unsigned size) : rank_(rank), size_(size), sockets_(size, -1) {}
+
+    [[noreturn]] static void Fail(const char* what) {
+        std::cerr << "Communicator: " << what << " failed: " << std::strerror(errno) << "\n";
+        std::cerr.flush();
+        _exit(EXIT_FAILURE);
+    }
+
+    void Send(unsigned peer, Transfer& transfer, const std::vector<uint8_t>& message) {
+        while (!transfer.IsDone()) {
+            const bool is_header = transfer.header_done < sizeof(transfer.length);
+            const uint8_t* data = is_header ? reinterpret_cast<const uint8_t*>(&transfer.length) + transfer.header_done
+                : message.data() + transfer.payload_done;
+            const size_t size = is_header ? sizeof(transfer.length) - transfer.header_done : transfer.length - transfer.payload_done;
+            const ssize_t sent = send(sockets_[peer], data, size, MSG_NOSIGNAL);
+            if (sent < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+                if (errno == EINTR) continue;
+                Fail("send");
+            }
+            (is_header ? transfer.header_done : transfer.payload_done) += static_cast<size_t>(sent);
+        }
+    }
+
+    void Receive(unsigned peer, Transfer& transfer, std::vector<uint8_t>& message) {
+        while (!transfer.IsDone()) {
+            const bool is_header = transfer.header_done < sizeof(transfer.length);
+            uint8_t* data = is_header ? reinterpret_cast<uint8_t*>(&transfer.length) + transfer.header_done
+                : message.data() + transfer.payload_done;
+            const size_t size = is_header ? sizeof(transfer.length) - transfer.header_done : transfer.length - transfer.payload_done;
+            const ssize_t received = recv(sockets_[peer], data, size, 0);
+            if (received == 0) {
+                errno = ECONNRESET;
+                Fail("recv");
+            }
+            if (received < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+                if (errno == EINTR) continue;
+                Fail("recv");
+            }
+            if (is_header) {
+                transfer.header_done += static_cast<size_t>(received);
+                if (transfer.header_done == sizeof(transfer.length)) message.resize(transfer.length);
+            }
+            else {
+                transfer.payload_done += static_cast<size_t>(received);
+            }
+        }
+    }
+};
@@ -0,0 +1,38 @@
+#pragma once
+#include "domain.h"
+#include "framework.h"
+#include "agent.h"
+#include "trail-map.h"
+
+// One rank's view of a world split between processes. The rank owns a band of trail
+// tile rows and the agents standing in it; the engine calls these at fixed points of
+// every step so the ranks stay in lock step. A single-process engine has none.
+class Decomposition {
+public:
+    virtual ~Decomposition() = default;
+
+    // Tile rows [first, end) of the sparse trail map belong to this rank.
+    virtual unsigned GetFirstTileRow() const = 0;
+    virtual unsigned GetEndTileRow() const = 0;
+
+    // Replaces this rank's step range and best agent with the population-wide ones.
+    virtual void ReduceFitness(FitnessRange& range, float& best_agent_fitness, Vector2f& best_position) = 0;
+
+    // Fills `partners` with a sample of the whole population's positions for the SMA
+    // partner draws; false if the local agents already are the whole population.
+    virtual bool GatherPartners(const AgentPool& agents, const RandomStream& random, std::vector<Vector2f>& partners) = 0;
+
+    // Sends the owned edge tile rows to the neighbouring ranks and replaces the halo rows
+    // next to them with theirs.
+    virtual void ExchangeHalo(TrailMap& trail_map) = 0;
+
+    // Leaves in `pixels` the food deposits that fall in the owned rows, from every rank:
+    // this rank's own in their order, then those sent by the others in rank order.
+    virtual void RouteDeposits(std::vector<uint32_t>& pixels) = 0;
+
+    // Hands agents that left the owned rows to their new owners and takes in arrivals.
+    virtual void MigrateAgents(AgentPool& agents) = 0;
+
+    // Whether an agent at height `y` belongs to this rank.
+    virtual bool OwnsRow(float y) const = 0;
+};
@@ -0,0 +1,86 @@
+#pragma once
+#include "domain.h"
+#include "parallel.h"
+#include "trail-map.h"
+
+// Adds equal deposits to the trail map from several threads. Pixels are binned by trail
+// tile with a counting sort over fixed-size chunks, then each task adds the deposits of
+// whole tiles, so no two threads write the same memory and no atomics are needed. Capped
+// additions of a single amount give the same value in any order, so the field matches a
+// serial loop bit for bit. Scratch is kept between calls.
+class DepositSplatter {
+public:
+    static constexpr uint32_t SKIP = std::numeric_limits<uint32_t>::max();
+
+    // Adds `amount` at pixel_of(i) for every i below `count`; SKIP leaves an item out.
+    template <typename PixelOf>
+    void Splat(size_t count, const PixelOf& pixel_of, float amount, TrailMap& trail_map, ThreadPool& pool) {
+        // Binning costs two more passes over the items, only worth it when they are shared out.
+        if (pool.GetThreadCount() == 1 || count < ITEMS_PER_CHUNK) {
+            for (size_t i = 0; i < count; ++i) {
+                const uint32_t pixel = pixel_of(i);
+                if (pixel != SKIP) trail_map.AddValue(static_cast<size_t>(pixel), amount);
+            }
+            return;
+        }
+
+        const unsigned width = trail_map.GetWidth();
+        const size_t tiles_x = (width + TILE - 1) / TILE;
+        const size_t bin_count = tiles_x * ((trail_map.GetHeight() + TILE - 1) / TILE);
+        const size_t chunk_count = (count + ITEMS_PER_CHUNK - 1) / ITEMS_PER_CHUNK;
+        const auto bin_of = [&](uint32_t pixel) { return pixel / width / TILE * tiles_x + pixel % width / TILE; };
+
+        pixels_.resize(count);
+        counts_.assign(chunk_count * bin_count, 0);
+        pool.Run(chunk_count, [&](size_t chunk) {
+            uint32_t* counts = &counts_[chunk * bin_count];
+            const size_t end = std::min(count, (chunk + 1) * ITEMS_PER_CHUNK);
+            for (size_t i = chunk * ITEMS_PER_CHUNK; i < end; ++i) {
+                const uint32_t pixel = pixel_of(i);
+                pixels_[i] = pixel;
+                if (pixel != SKIP) ++counts[bin_of(pixel)];
+            }
+            });
+
+        // Turn the counts into each chunk's first slot in its bin. A sparse map gets the
+        // tiles it is missing here, since taking one from its pool is not thread-safe.
+        bin_starts_.resize(bin_count + 1);
+        uint32_t offset = 0;
+        for (size_t bin = 0; bin < bin_count; ++bin) {
+            bin_starts_[bin] = offset;
+            for (size_t chunk = 0; chunk < chunk_count; ++chunk) {
+                const uint32_t chunk_total = counts_[chunk * bin_count + bin];
+                counts_[chunk * bin_count + bin] = offset;
+                offset += chunk_total;
+            }
+            if (offset != bin_starts_[bin]) {
+                trail_map.PrepareTile(static_cast<unsigned>(bin % tiles_x) * TILE, static_cast<unsigned>(bin / tiles_x) * TILE);
+            }
+        }
+        bin_starts_[bin_count] = offset;
+
+        binned_.resize(offset);
+        pool.Run(chunk_count, [&](size_t chunk) {
+            uint32_t* slots = &counts_[chunk * bin_count];
+            const size_t end = std::min(count, (chunk + 1) * ITEMS_PER_CHUNK);
+            for (size_t i = chunk * ITEMS_PER_CHUNK; i < end; ++i) {
+                if (pixels_[i] != SKIP) binned_[slots[bin_of(pixels_[i])]++] = pixels_[i];
+            }
+            });
+
+        pool.Run(bin_count, [&](size_t bin) {
+            for (uint32_t k = bin_starts_[bin]; k < bin_starts_[bin + 1]; ++k) {
+                trail_map.AddValue(static_cast<size_t>(binned_[k]), amount);
+            }
+            });
+    }
+
+private:
+    static constexpr unsigned TILE = TiledField::TILE;
+    static constexpr size_t ITEMS_PER_CHUNK = 1 << 16;
+
+    std::vector<uint32_t> pixels_;
+    std::vector<uint32_t> counts_;
+    std::vector<uint32_t> bin_starts_;
+    std::vector<uint32_t> binned_;
+};
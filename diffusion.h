@@ -0,0 +1,306 @@
+#pragma once
+#include "domain.h"
+#include "parallel.h"
+
+#include <array>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SLIME_SIMD_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SLIME_SIMD_SSE2
+#endif
+
+// Decaying trails underflow into denormals, which x86 processes many times slower. The
+// kernels run with flush-to-zero and denormals-are-zero, restoring the caller's mode after.
+class DenormalGuard {
+public:
+#if defined(SLIME_SIMD_AVX2) || defined(SLIME_SIMD_SSE2)
+    DenormalGuard() : saved_(_mm_getcsr()) { _mm_setcsr(saved_ | 0x8040); }
+    ~DenormalGuard() { _mm_setcsr(saved_); }
+
+private:
+    unsigned saved_;
+#endif
+};
+
+// Taps of a 1D filter as parallel arrays, at most one per distinct offset.
+struct FilterTaps {
+    std::array<int, 9> offsets{};
+    std::array<float, 9> weights{};
+    size_t count = 0;
+    int min_offset = 0;
+    int max_offset = 0;
+};
+
+// The former blur shaders sampled 9 taps `strength` pixels apart with nearest filtering;
+// taps that land on the same pixel are merged.
+FilterTaps CalculateGaussianTaps(float strength) {
+    FilterTaps taps;
+    for (int k = -4; k <= 4; ++k) {
+        const int offset = static_cast<int>(std::floor(0.5f + k * strength));
+        const float weight = diffusion::GAUSSIAN_WEIGHTS[std::abs(k)];
+
+        size_t t = 0;
+        while (t < taps.count && taps.offsets[t] != offset) ++t;
+        if (t == taps.count) {
+            taps.offsets[taps.count] = offset;
+            taps.weights[taps.count] = 0.0f;
+            ++taps.count;
+        }
+        taps.weights[t] += weight;
+        taps.min_offset = std::min(taps.min_offset, offset);
+        taps.max_offset = std::max(taps.max_offset, offset);
+    }
+    return taps;
+}
+
+// Radii of three box filters whose repeated application approximates the Gaussian
+// taps above (Kutskir, "Fastest Gaussian blur").
+std::array<int, 3> CalculateBoxRadii(float strength) {
+    const FilterTaps taps = CalculateGaussianTaps(strength);
+    float variance = 0.0f;
+    for (size_t t = 0; t < taps.count; ++t) {
+        variance += taps.weights[t] * static_cast<float>(taps.offsets[t] * taps.offsets[t]);
+    }
+
+    const int passes = 3;
+    int lower = static_cast<int>(std::floor(std::sqrt(12.0f * variance / passes + 1.0f)));
+    if (lower % 2 == 0) --lower;
+    const int upper = lower + 2;
+    const float ideal = (12.0f * variance - passes * lower * lower - 4.0f * passes * lower - 3.0f * passes) / (-4.0f * lower - 4.0f);
+    const int lower_count = static_cast<int>(std::round(ideal));
+
+    std::array<int, 3> radii{};
+    for (int i = 0; i < passes; ++i) {
+        radii[i] = ((i < lower_count ? lower : upper) - 1) / 2;
+    }
+    // At small strengths every radius rounds to 0 and the boxes would not blur at all, while
+    // the Gaussian taps still reach the neighbouring pixels; one pass of radius 1 keeps that.
+    if (radii[passes - 1] == 0 && taps.max_offset > 0) radii[passes - 1] = 1;
+    return radii;
+}
+
+// out[i] = sum of weights[t] * in[i + offsets[t]]
+void ConvolveRow(const float* in, const FilterTaps& taps, const float* weights, float* out, size_t count) {
+    size_t i = 0;
+#if defined(SLIME_SIMD_AVX2)
+    for (; i + 8 <= count; i += 8) {
+        __m256 sum = _mm256_setzero_ps();
+        for (size_t t = 0; t < taps.count; ++t) {
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(weights[t]), _mm256_loadu_ps(in + i + taps.offsets[t])));
+        }
+        _mm256_storeu_ps(out + i, sum);
+    }
+#elif defined(SLIME_SIMD_SSE2)
+    for (; i + 4 <= count; i += 4) {
+        __m128 sum = _mm_setzero_ps();
+        for (size_t t = 0; t < taps.count; ++t) {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[t]), _mm_loadu_ps(in + i + taps.offsets[t])));
+        }
+        _mm_storeu_ps(out + i, sum);
+    }
+#endif
+    for (; i < count; ++i) {
+        float sum = 0.0f;
+        for (size_t t = 0; t < taps.count; ++t) {
+            sum += weights[t] * in[i + taps.offsets[t]];
+        }
+        out[i] = sum;
+    }
+}
+
+// out[i] = sum of weights[t] * rows[t][i]
+void CombineRows(const float* const* rows, const float* weights, size_t row_count, float* out, size_t count) {
+    size_t i = 0;
+#if defined(SLIME_SIMD_AVX2)
+    for (; i + 8 <= count; i += 8) {
+        __m256 sum = _mm256_setzero_ps();
+        for (size_t t = 0; t < row_count; ++t) {
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(weights[t]), _mm256_loadu_ps(rows[t] + i)));
+        }
+        _mm256_storeu_ps(out + i, sum);
+    }
+#elif defined(SLIME_SIMD_SSE2)
+    for (; i + 4 <= count; i += 4) {
+        __m128 sum = _mm_setzero_ps();
+        for (size_t t = 0; t < row_count; ++t) {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[t]), _mm_loadu_ps(rows[t] + i)));
+        }
+        _mm_storeu_ps(out + i, sum);
+    }
+#endif
+    for (; i < count; ++i) {
+        float sum = 0.0f;
+        for (size_t t = 0; t < row_count; ++t) {
+            sum += weights[t] * rows[t][i];
+        }
+        out[i] = sum;
+    }
+}
+
+// One step of a running box sum over many columns at once: out = sum * scale, then the
+// window moves on by one row.
+void SlideWindow(float* sum, const float* entering, const float* leaving, float scale, float* out, size_t count) {
+    size_t i = 0;
+#if defined(SLIME_SIMD_AVX2)
+    const __m256 scale8 = _mm256_set1_ps(scale);
+    for (; i + 8 <= count; i += 8) {
+        const __m256 current = _mm256_loadu_ps(sum + i);
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(current, scale8));
+        _mm256_storeu_ps(sum + i, _mm256_add_ps(current, _mm256_sub_ps(_mm256_loadu_ps(entering + i), _mm256_loadu_ps(leaving + i))));
+    }
+#elif defined(SLIME_SIMD_SSE2)
+    const __m128 scale4 = _mm_set1_ps(scale);
+    for (; i + 4 <= count; i += 4) {
+        const __m128 current = _mm_loadu_ps(sum + i);
+        _mm_storeu_ps(out + i, _mm_mul_ps(current, scale4));
+        _mm_storeu_ps(sum + i, _mm_add_ps(current, _mm_sub_ps(_mm_loadu_ps(entering + i), _mm_loadu_ps(leaving + i))));
+    }
+#endif
+    for (; i < count; ++i) {
+        out[i] = sum[i] * scale;
+        sum[i] += entering[i] - leaving[i];
+    }
+}
+
+// One box filter pass along a row, clamping at both ends.
+void BoxRow(const float* in, float* out, unsigned width, int radius) {
+    const int last = static_cast<int>(width) - 1;
+    const float scale = 1.0f / (2 * radius + 1);
+
+    float sum = (radius + 1) * in[0];
+    for (int k = 1; k <= radius; ++k) sum += in[std::min(k, last)];
+
+    for (int x = 0; x <= last; ++x) {
+        out[x] = sum * scale;
+        sum += in[std::min(x + radius + 1, last)] - in[std::max(x - radius, 0)];
+    }
+}
+
+// The same pass down `columns` adjacent columns at once, rows `columns` floats apart.
+void BoxColumns(const float* in, float* out, float* sum, size_t columns, unsigned height, int radius) {
+    const int last = static_cast<int>(height) - 1;
+    const float scale = 1.0f / (2 * radius + 1);
+
+    for (size_t j = 0; j < columns; ++j) sum[j] = (radius + 1) * in[j];
+    for (int k = 1; k <= radius; ++k) {
+        const float* row = in + std::min(k, last) * columns;
+        for (size_t j = 0; j < columns; ++j) sum[j] += row[j];
+    }
+
+    for (int y = 0; y <= last; ++y) {
+        SlideWindow(sum, in + std::min(y + radius + 1, last) * columns, in + std::max(y - radius, 0) * columns,
+            scale, out + y * columns, columns);
+    }
+}
+
+// Decay and diffusion of the trail field in one pass over memory. Scratch buffers are
+// kept between calls, one per task, so steady-state steps do not allocate.
+class Diffuser {
+public:
+    void Apply(const std::vector<float>& src, std::vector<float>& dst, unsigned width, unsigned height,
+        float rate, float strength, diffusion::Operator blur, ThreadPool& pool) {
+        if (blur == diffusion::BOX) ApplyBox(src, dst, width, height, rate, strength, pool);
+        else ApplyGaussian(src, dst, width, height, rate, strength, pool);
+    }
+
+private:
+    static constexpr size_t BAND_ROWS = 32;
+    static constexpr size_t STRIP_COLUMNS = 64;
+
+    std::vector<std::vector<float>> scratch_;
+
+    // Each task owns a band of output rows: it blurs the rows the band needs horizontally
+    // into a private buffer that stays in cache, then combines them vertically. Decay is
+    // linear, so it is folded into the horizontal weights.
+    void ApplyGaussian(const std::vector<float>& src, std::vector<float>& dst, unsigned width, unsigned height,
+        float rate, float strength, ThreadPool& pool) {
+        const FilterTaps taps = CalculateGaussianTaps(strength);
+        std::array<float, 9> decayed_weights{};
+        for (size_t t = 0; t < taps.count; ++t) decayed_weights[t] = taps.weights[t] * rate;
+
+        const int pad = std::max(-taps.min_offset, taps.max_offset);
+        const size_t band_count = (height + BAND_ROWS - 1) / BAND_ROWS;
+        if (scratch_.size() < band_count) scratch_.resize(band_count);
+
+        pool.Run(band_count, [&](size_t band) {
+            const DenormalGuard guard;
+            const int y0 = static_cast<int>(band * BAND_ROWS);
+            const int y1 = std::min(static_cast<int>(height), y0 + static_cast<int>(BAND_ROWS));
+            const int r0 = std::max(0, y0 + taps.min_offset);
+            const int r1 = std::min(static_cast<int>(height), y1 + taps.max_offset);
+
+            std::vector<float>& scratch = scratch_[band];
+            scratch.resize(static_cast<size_t>(r1 - r0) * width + width + 2 * pad);
+            float* padded = scratch.data() + static_cast<size_t>(r1 - r0) * width;
+
+            for (int r = r0; r < r1; ++r) {
+                const float* row = &src[static_cast<size_t>(r) * width];
+                std::fill(padded, padded + pad, row[0]);
+                std::copy(row, row + width, padded + pad);
+                std::fill(padded + pad + width, padded + 2 * pad + width, row[width - 1]);
+                ConvolveRow(padded + pad, taps, decayed_weights.data(), &scratch[static_cast<size_t>(r - r0) * width], width);
+            }
+
+            std::array<const float*, 9> rows{};
+            for (int y = y0; y < y1; ++y) {
+                for (size_t t = 0; t < taps.count; ++t) {
+                    const int r = std::clamp(y + taps.offsets[t], 0, static_cast<int>(height) - 1);
+                    rows[t] = &scratch[static_cast<size_t>(r - r0) * width];
+                }
+                CombineRows(rows.data(), taps.weights.data(), taps.count, &dst[static_cast<size_t>(y) * width], width);
+            }
+            });
+    }
+
+    // Three box passes per axis with running sums: the cost per pixel does not grow with the radius.
+    void ApplyBox(const std::vector<float>& src, std::vector<float>& dst, unsigned width, unsigned height,
+        float rate, float strength, ThreadPool& pool) {
+        const std::array<int, 3> radii = CalculateBoxRadii(strength);
+
+        const size_t band_count = (height + BAND_ROWS - 1) / BAND_ROWS;
+        const size_t strip_count = (width + STRIP_COLUMNS - 1) / STRIP_COLUMNS;
+        if (scratch_.size() < std::max(band_count, strip_count)) scratch_.resize(std::max(band_count, strip_count));
+
+        pool.ParallelFor(height, BAND_ROWS, [&](size_t begin, size_t end) {
+            const DenormalGuard guard;
+            std::vector<float>& scratch = scratch_[begin / BAND_ROWS];
+            scratch.resize(2 * static_cast<size_t>(width));
+            float* a = scratch.data();
+            float* b = a + width;
+
+            for (size_t y = begin; y < end; ++y) {
+                const float* row = &src[y * width];
+                for (unsigned x = 0; x < width; ++x) a[x] = row[x] * rate;
+                for (int radius : radii) {
+                    BoxRow(a, b, width, radius);
+                    std::swap(a, b);
+                }
+                std::copy(a, a + width, &dst[y * width]);
+            }
+            });
+
+        pool.ParallelFor(width, STRIP_COLUMNS, [&](size_t begin, size_t end) {
+            const DenormalGuard guard;
+            const size_t columns = end - begin;
+            std::vector<float>& scratch = scratch_[begin / STRIP_COLUMNS];
+            scratch.resize(2 * static_cast<size_t>(height) * columns + columns);
+            float* a = scratch.data();
+            float* b = a + static_cast<size_t>(height) * columns;
+            float* sum = b + static_cast<size_t>(height) * columns;
+
+            for (unsigned y = 0; y < height; ++y) {
+                std::copy(&dst[y * width + begin], &dst[y * width + end], a + y * columns);
+            }
+            for (int radius : radii) {
+                BoxColumns(a, b, sum, columns, height, radius);
+                std::swap(a, b);
+            }
+            for (unsigned y = 0; y < height; ++y) {
+                std::copy(a + y * columns, a + (y + 1) * columns, &dst[y * width + begin]);
+            }
+            });
+    }
+};
@@ -0,0 +1,175 @@
+#include "domain.h"
+#include "framework.h"
+#include "engine.h"
+#include "strip-decomposition.h"
+
+#include <chrono>
+
+// What the headless checksum reads of an agent, tagged with its id.
+struct AgentSummary {
+    uint32_t id;
+    float values[4];
+};
+
+template <typename T>
+void AppendBytes(std::vector<uint8_t>& bytes, const T* data, size_t count) {
+    const size_t offset = bytes.size();
+    bytes.resize(offset + count * sizeof(T));
+    if (count != 0) std::memcpy(&bytes[offset], data, count * sizeof(T));
+}
+
+struct RankLoad {
+    uint64_t agents;
+    uint64_t trail_bytes;
+};
+
+// FNV-1a over the agents in id order and the trail map rows, gathered to rank 0: the same
+// bytes as slime_headless hashes for an unsplit run without --reorder-every, so the two
+// checksums match whenever the runs do. Other ranks get 0.
+uint64_t GatherChecksum(Communicator& communicator, const Engine& engine, const Decomposition& decomposition) {
+    const AgentPool& agents = engine.GetAgents();
+    std::vector<AgentSummary> summaries(agents.Size());
+    for (size_t i = 0; i < agents.Size(); ++i) {
+        const Vector2f position = agents.GetPos(i);
+        summaries[i] = { agents.GetId(i), { position.x, position.y, agents.GetHeading(i), agents.GetWeight(i) } };
+    }
+    std::vector<uint8_t> local;
+    AppendBytes(local, summaries.data(), summaries.size());
+    std::vector<std::vector<uint8_t>> gathered_agents;
+    communicator.Gather(local, gathered_agents);
+
+    const TrailMap& trail_map = engine.GetTrailMap();
+    const unsigned first_row = decomposition.GetFirstTileRow() * TiledField::TILE;
+    const unsigned end_row = std::min(decomposition.GetEndTileRow() * TiledField::TILE, trail_map.GetHeight());
+    std::vector<float> row(trail_map.GetWidth());
+    local.clear();
+    for (unsigned y = first_row; y < end_row; ++y) {
+        trail_map.CopyRow(y, row.data());
+        AppendBytes(local, row.data(), row.size());
+    }
+    std::vector<std::vector<uint8_t>> gathered_trail;
+    communicator.Gather(local, gathered_trail);
+    if (communicator.GetRank() != 0) return 0;
+
+    summaries.clear();
+    for (const auto& bytes : gathered_agents) {
+        const size_t first = summaries.size();
+        summaries.resize(first + bytes.size() / sizeof(AgentSummary));
+        if (!bytes.empty()) std::memcpy(&summaries[first], bytes.data(), bytes.size());
+    }
+    std::sort(summaries.begin(), summaries.end(), [](const AgentSummary& a, const AgentSummary& b) { return a.id < b.id; });
+
+    uint64_t hash = 14695981039346656037ull;
+    const auto mix = [&](const void* data, size_t size) {
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+    };
+    for (const AgentSummary& summary : summaries) mix(summary.values, sizeof(summary.values));
+    for (const auto& bytes : gathered_trail) mix(bytes.data(), bytes.size());
+    return hash;
+}
+
+// Runs the steps split between `ranks` processes. Only rank 0 returns; false if a rank failed.
+bool RunSteps(Settings settings, unsigned ranks, bool is_verbose, double& steps_per_second) {
+    Communicator communicator = Communicator::Launch(ranks);
+    if (settings.threads == 0) settings.threads = std::max(1u, std::thread::hardware_concurrency() / ranks);
+
+    const auto setup_start = std::chrono::steady_clock::now();
+    StripDecomposition decomposition(communicator, MakeContext(settings));
+    Engine engine(settings, &decomposition);
+    communicator.Barrier();
+    const std::chrono::duration<double> setup_time = std::chrono::steady_clock::now() - setup_start;
+
+    const auto start = std::chrono::steady_clock::now();
+    engine.Step(settings.steps);
+    communicator.Barrier();
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    steps_per_second = elapsed.count() > 0 ? settings.steps / elapsed.count() : 0.0;
+
+    if (is_verbose) {
+        const RankLoad local = { engine.GetAgents().Size(), engine.GetTrailMap().GetMemoryBytes() };
+        std::vector<RankLoad> loads;
+        communicator.AllGatherValue(local, loads);
+        const uint64_t checksum = GatherChecksum(communicator, engine, decomposition);
+
+        if (communicator.GetRank() == 0) {
+            uint64_t agents = 0, fewest = std::numeric_limits<uint64_t>::max(), most = 0, trail_bytes = 0;
+            for (const auto& load : loads) {
+                agents += load.agents;
+                fewest = std::min(fewest, load.agents);
+                most = std::max(most, load.agents);
+                trail_bytes += load.trail_bytes;
+            }
+            const SimulationContext& context = engine.GetContext();
+            std::cout << "Frame " << context.width << "x" << context.height
+                << ", agents " << agents
+                << ", food " << engine.GetFood().size()
+                << ", ranks " << ranks
+                << ", threads per rank " << engine.GetThreadCount()
+                << ", setup " << setup_time.count() << " s\n"
+                << "Steps " << settings.steps
+                << ", time " << elapsed.count() << " s"
+                << ", steps/sec " << steps_per_second
+                << ", agent-steps/sec " << steps_per_second * agents << "\n"
+                << "Agents per rank " << fewest << " to " << most
+                << ", trail maps " << trail_bytes / (1024.0 * 1024.0) << " MiB in total\n"
+                << "Checksum " << std::hex << checksum << std::dec << "\n";
+        }
+    }
+    return communicator.Finish(EXIT_SUCCESS) == EXIT_SUCCESS;
+}
+
+bool RunScaling(const Settings& settings) {
+    std::vector<unsigned> rank_counts;
+    for (unsigned ranks = 1; ranks < settings.ranks; ranks *= 2) rank_counts.push_back(ranks);
+    rank_counts.push_back(settings.ranks);
+
+    std::cout << "ranks;steps/sec;speedup;efficiency\n";
+    double baseline = 0.0;
+    for (unsigned ranks : rank_counts) {
+        double steps_per_second = 0.0;
+        if (!RunSteps(settings, ranks, false, steps_per_second)) return false;
+        if (baseline == 0.0) baseline = steps_per_second;
+
+        const double speedup = baseline > 0 ? steps_per_second / baseline : 0.0;
+        std::cout << ranks << ";" << steps_per_second << ";" << speedup << ";" << speedup / ranks << "\n";
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    Settings settings;
+    if (!ParseSettings(argc, argv, settings)) return EXIT_FAILURE;
+
+    if (!settings.snapshot_path.empty() || !settings.resume_path.empty() || !settings.trajectory_path.empty()
+        || settings.until_converged || settings.adaptive_population) {
+        std::cerr << "Snapshots, trajectories, --until-converged and --adaptive-population need an unsplit run, use slime_headless\n";
+        return EXIT_FAILURE;
+    }
+
+    // Every rank must draw the same world.
+    if (settings.seed == 0) settings.seed = static_cast<unsigned>(time(nullptr));
+    const SimulationContext context = MakeContext(settings);
+    if (TiledField::GetReach(context.blur_strength, context.blur) > static_cast<int>(TiledField::TILE)) {
+        std::cerr << "Blur strength " << context.blur_strength << " reaches past a trail tile, the halo would be too thin\n";
+        return EXIT_FAILURE;
+    }
+    // An agent moves before it senses, so it reads the trail up to this far outside its strip.
+    if (context.speed + context.sensor_distance > TiledField::TILE) {
+        std::cerr << "Speed " << context.speed << " and sensor distance " << context.sensor_distance
+            << " reach past a trail tile, the halo would be too thin\n";
+        return EXIT_FAILURE;
+    }
+    const unsigned tile_rows = (context.height + TiledField::TILE - 1) / TiledField::TILE;
+    if (settings.ranks > tile_rows) {
+        std::cerr << "A height of " << context.height << " has " << tile_rows << " trail tile rows, too few for "
+            << settings.ranks << " ranks\n";
+        return EXIT_FAILURE;
+    }
+
+    double steps_per_second = 0.0;
+    const bool ok = settings.scaling ? RunScaling(settings) : RunSteps(settings, settings.ranks, true, steps_per_second);
+    return ok ? 0 : EXIT_FAILURE;
+}
@@ -9,22 +9,35 @@
 #include <random>
 #include <iostream>
 #include <functional>
-
-#include <SFML/Graphics.hpp>
-#include <SFML/Window.hpp>
+#include <cstdint>
+#include <cstdlib>
+#include <iterator>
+#include <string>
 
 #include "random-hash.h"
 
-struct Sensor {
-    sf::Vector2f right;
-    sf::Vector2f left;
-    sf::Vector2f forward;
+struct Vector2f {
+    float x = 0.0f;
+    float y = 0.0f;
 };
 
-namespace config {
-    unsigned WIDTH;
-    unsigned HEIGHT;
-    unsigned NUM_AGENTS;
+inline Vector2f operator+(const Vector2f& a, const Vector2f& b) { return { a.x + b.x, a.y + b.y }; }
+inline Vector2f operator-(const Vector2f& a, const Vector2f& b) { return { a.x - b.x, a.y - b.y }; }
+inline Vector2f operator*(float k, const Vector2f& v) { return { k * v.x, k * v.y }; }
+inline bool operator==(const Vector2f& a, const Vector2f& b) { return a.x == b.x && a.y == b.y; }
+inline bool operator!=(const Vector2f& a, const Vector2f& b) { return !(a == b); }
+
+struct Color {
+    uint8_t r = 0;
+    uint8_t g = 0;
+    uint8_t b = 0;
+    uint8_t a = 255;
+};
+
+struct Sensor {
+    Vector2f right;
+    Vector2f left;
+    Vector2f forward;
 };
 
 namespace constant {
@@ -33,17 +46,21 @@ namespace constant {
 
     const float PI = 3.1415926535897932384626433832795028f;
     const int FPS = 40;
+    // Frames without input the viewer runs before --check-allocations starts counting.
+    const unsigned ALLOCATION_WARMUP_FRAMES = 120;
 }
 
 namespace food {
     const float RADIUS = 3.0f;
-    sf::Color COLOR = sf::Color::Green;
+    Color COLOR = { 0, 255, 0, 255 };
 }
 
+// Defaults of the modes and parameters below; a simulation's own values live in its
+// SimulationContext.
 namespace mode {
-    bool IS_POLLING = true;
-    bool IS_MAZE = false;
-    bool IS_RUN = true;
+    const bool IS_POLLING = true;
+    const bool IS_MAZE = false;
+    const bool IS_RUN = true;
 
     enum Type {
         NOISE,
@@ -52,7 +69,7 @@ namespace mode {
         TWO_POINTS,
         THREE_POINTS
     };
-    Type CURRENT = CIRCLE;
+    const Type CURRENT = CIRCLE;
 }
 
 namespace frame {
@@ -62,7 +79,7 @@ namespace frame {
         MEDIUM,
         BIG
     };
-    Size CURRENT = MINI;
+    const Size CURRENT = MINI;
 }
 
 namespace sensor {
@@ -72,66 +89,58 @@ namespace sensor {
 }
 
 namespace agent {
-    float SPEED = 0.8f;
-    float ROTATION_ANGLE = 22.5f;
-    sf::Color COLOR = sf::Color(255, 255, 255, 70);
+    const float SPEED = 0.8f;
+    const float ROTATION_ANGLE = 22.5f;
+    Color COLOR = { 255, 255, 255, 70 };
 }
 
-namespace population {
-    sf::Vector2f BEST_POSITION;
-    float BEST_FITNESS;
-    float WORST_FITNESS;
-};
-
 namespace simulation {
-    int ITER = 1;
-    int MAX_ITERATION = 10;
-    sf::Vector2f BEST_FOOD_POS = { 0.0f,0.0f };
+    const int MAX_ITERATION = 10;
     const float DECAY_RATE = 0.97f;
     const float BOUNDARY_OFFSET = 0.0f;
     const float BLUR_STRENGTH = 0.2f;
     const float A_DIFFUSION_STRENGTH = 1.0f;
     const float ANGLE_RESPONSIVNESS = 0.1f;
-
+    const size_t AGENTS_PER_TASK = 1024;
+
+    // Trail units are the channel mean of the old RGBA trail texture: an agent used to
+    // add (10w, 10(1 - w), 255) per frame and a food deposit 50 to red.
+    const float TRAIL_MAX = 255.0f;
+    const float AGENT_DEPOSIT = 265.0f / 3.0f;
+    const float FOOD_DEPOSIT = 50.0f / 3.0f;
+
+    // A sparse trail map drops tiles once every value in them has decayed below this,
+    // about 400 steps after the last deposit.
+    const float TRAIL_TILE_FREE_BELOW = 1e-3f;
+
+    // Agents in the partner sample a rank of a split world draws XA and XB from, on average.
+    const unsigned PARTNER_SAMPLE_SIZE = 4096;
+
+    // The network never freezes, so it counts as converged once the change of its coarse
+    // layout (trail sums over TRAIL_BLOCK pixel squares) has not reached a new low, by
+    // CONVERGENCE_MIN_IMPROVEMENT, for CONVERGENCE_PATIENCE checks.
+    const unsigned CONVERGENCE_CHECK_EVERY = 50;
+    const unsigned CONVERGENCE_PATIENCE = 10;
+    const float CONVERGENCE_MIN_IMPROVEMENT = 0.05f;
+    const float CONVERGENCE_SMOOTHING = 0.3f;
+    const unsigned TRAIL_BLOCK = 16;
+
+    // --adaptive-population retires, at every convergence check, this share of the agents in
+    // blocks whose trail sum changed by less than ADAPTIVE_SETTLED_CHANGE since the previous
+    // check, and keeps at least ADAPTIVE_MIN_AGENTS of the starting population.
+    const float ADAPTIVE_SETTLED_CHANGE = 0.05f;
+    const float ADAPTIVE_RETIRE_RATE = 0.2f;
+    const float ADAPTIVE_MIN_AGENTS = 0.25f;
 }
 
-namespace shader {
-    const std::string HORIZONTAL_BLUR = R"(
-        uniform sampler2D texture;
-        uniform float offset;
-    
-        void main() {
-            vec2 texCoords = gl_TexCoord[0].xy;
-            vec4 color = texture2D(texture, texCoords) * 0.227027;
-            color += texture2D(texture, texCoords + vec2(offset * 1.0, 0.0)) * 0.1945946;
-            color += texture2D(texture, texCoords - vec2(offset * 1.0, 0.0)) * 0.1945946;
-            color += texture2D(texture, texCoords + vec2(offset * 2.0, 0.0)) * 0.1216216;
-            color += texture2D(texture, texCoords - vec2(offset * 2.0, 0.0)) * 0.1216216;
-            color += texture2D(texture, texCoords + vec2(offset * 3.0, 0.0)) * 0.054054;
-            color += texture2D(texture, texCoords - vec2(offset * 3.0, 0.0)) * 0.054054;
-            color += texture2D(texture, texCoords + vec2(offset * 4.0, 0.0)) * 0.016216;
-            color += texture2D(texture, texCoords - vec2(offset * 4.0, 0.0)) * 0.016216;
-            gl_FragColor = color;
-        }
-    )";
-    const std::string VERTICAL_BLUR = R"(
-        uniform sampler2D texture;
-        uniform float offset;
-    
-        void main() {
-            vec2 texCoords = gl_TexCoord[0].xy;
-            vec4 color = texture2D(texture, texCoords) * 0.227027;
-            color += texture2D(texture, texCoords + vec2(0.0, offset * 1.0)) * 0.1945946;
-            color += texture2D(texture, texCoords - vec2(0.0, offset * 1.0)) * 0.1945946;
-            color += texture2D(texture, texCoords + vec2(0.0, offset * 2.0)) * 0.1216216;
-            color += texture2D(texture, texCoords - vec2(0.0, offset * 2.0)) * 0.1216216;
-            color += texture2D(texture, texCoords + vec2(0.0, offset * 3.0)) * 0.054054;
-            color += texture2D(texture, texCoords - vec2(0.0, offset * 3.0)) * 0.054054;
-            color += texture2D(texture, texCoords + vec2(0.0, offset * 4.0)) * 0.016216;
-            color += texture2D(texture, texCoords - vec2(0.0, offset * 4.0)) * 0.016216;
-            gl_FragColor = color;
-        }
-    )";
+namespace diffusion {
+    const float GAUSSIAN_WEIGHTS[5] = { 0.227027f, 0.1945946f, 0.1216216f, 0.054054f, 0.016216f };
+
+    enum Operator {
+        GAUSSIAN,
+        BOX
+    };
+    const Operator CURRENT = GAUSSIAN;
 }
 
 namespace maze {
@@ -0,0 +1,587 @@
+#pragma once
+#include "domain.h"
+#include "framework.h"
+#include "settings.h"
+#include "parallel.h"
+#include "trail-map.h"
+#include "food-map.h"
+#include "obstacle-map.h"
+#include "agent.h"
+#include "spatial-sort.h"
+#include "trace.h"
+#include "perf-counters.h"
+#include "snapshot.h"
+#include "trajectory.h"
+#include "decomposition.h"
+#include "deposit-splatter.h"
+
+// Stagnation of the trail network, checked every simulation::CONVERGENCE_CHECK_EVERY
+// steps while tracking. trail_change is the relative L1 change of the block sums since
+// the previous check, smoothed_trail_change its running average. best_fitness_change is the
+// relative change of the step's best agent fitness since the previous check and
+// weight_variance the variance of the agents' food weights; both stay 0 without food.
+struct ConvergenceState {
+    bool is_tracking = false;
+    bool is_converged = false;
+    unsigned checks = 0;
+    float trail_change = 1.0f;
+    float smoothed_trail_change = 1.0f;
+    float best_fitness = 0.0f;
+    float best_fitness_change = 0.0f;
+    float weight_variance = 0.0f;
+    float lowest_trail_change = std::numeric_limits<float>::max();
+    unsigned stalled_checks = 0;
+};
+
+// Trail map cache misses of one pass over the agents' pixels, in agent order, before and
+// after each spatial reorder. Counted with a direct-mapped 32 KiB model cache per task.
+struct ReorderStats {
+    unsigned long long passes = 0;
+    unsigned long long misses_before = 0;
+    unsigned long long misses_after = 0;
+};
+
+class Engine {
+public:
+    // With a decomposition the engine runs one rank of a split world: it keeps the agents
+    // and trail tile rows the decomposition assigns to it, in a sparse trail map.
+    explicit Engine(const Settings& settings, Decomposition* decomposition = nullptr)
+        : settings_(settings), thread_pool_(settings.threads), decomposition_(decomposition) {
+        // A snapshot decides the frame, the agents, the seed and the maze.
+        SnapshotFile snapshot;
+        const bool is_resuming = !settings_.resume_path.empty() && OpenSnapshot(snapshot);
+        if (is_resuming) {
+            const SnapshotHeader& header = snapshot.GetHeader();
+            settings_.width = header.width;
+            settings_.height = header.height;
+            settings_.num_agents = static_cast<unsigned>(header.agent_count);
+            settings_.seed = header.seed;
+            settings_.is_maze = snapshot.Find(snapshot::WALL_BITS).size != 0;
+        }
+
+        if (settings_.seed == 0) settings_.seed = static_cast<unsigned>(time(nullptr));
+        context_ = MakeContext(settings_);
+
+        const RandomStream random(settings_.seed, 0);
+        if (decomposition_) settings_.is_sparse_trail = true;
+        else if (settings_.is_sparse_trail && TiledField::GetReach(context_.blur_strength, context_.blur) > static_cast<int>(TiledField::TILE)) {
+            std::cerr << "Blur strength " << context_.blur_strength << " reaches past a trail tile, using a dense trail map\n";
+            settings_.is_sparse_trail = false;
+        }
+        trail_map_ = TrailMap(context_.width, context_.height, settings_.is_sparse_trail);
+        agents_ = AgentPool(context_.num_agents, random, context_);
+        if (is_resuming) {
+            RestoreSnapshot(snapshot);
+        }
+        else {
+            if (context_.is_maze) LoadMaze();
+
+            food_positions_ = settings_.food;
+            for (unsigned i = 0; i < settings_.food_count; ++i) {
+                food_positions_.push_back({
+                    static_cast<float>(random.Next(i, draw::FOOD_X) % context_.width),
+                    static_cast<float>(random.Next(i, draw::FOOD_Y) % context_.height)
+                });
+            }
+        }
+
+        if (decomposition_) {
+            std::vector<uint8_t> is_owned(agents_.Size());
+            for (size_t i = 0; i < agents_.Size(); ++i) is_owned[i] = decomposition_->OwnsRow(agents_.GetPos(i).y);
+            agents_.Compact(is_owned);
+        }
+
+        if (!settings_.trajectory_path.empty()) OpenTrajectory();
+        if (settings_.adaptive_population && (trajectory_ || decomposition_)) {
+            std::cerr << "Trajectories and split worlds need a fixed population, ignoring --adaptive-population\n";
+            settings_.adaptive_population = false;
+        }
+    }
+
+    Engine(const Engine&) = delete;
+    Engine& operator=(const Engine&) = delete;
+
+    void Step(unsigned count = 1) {
+        for (unsigned i = 0; i < count; ++i) {
+            StepOnce();
+        }
+    }
+
+    void AddFood(const Vector2f& position) {
+        food_positions_.push_back(position);
+        is_food_map_stale_ = true;
+    }
+
+    bool RemoveFood(const Vector2f& position, float radius) {
+        if (food_positions_.empty()) return false;
+
+        auto closest = std::min_element(food_positions_.begin(), food_positions_.end(), [&](const Vector2f& a, const Vector2f& b) {
+            return Distance(position, a) < Distance(position, b);
+            });
+
+        if (Distance(position, *closest) > radius) return false;
+        food_positions_.erase(closest);
+        is_food_map_stale_ = true;
+        return true;
+    }
+
+    // Copies everything the next step depends on. Call it between steps; writing the copy
+    // out can then happen on another thread.
+    void CaptureSnapshot(Snapshot& snapshot) const {
+        snapshot.sections.clear();
+        SnapshotHeader& header = snapshot.header;
+        header.width = context_.width;
+        header.height = context_.height;
+        header.agent_count = agents_.Size();
+        header.step_count = step_count_;
+        header.seed = settings_.seed;
+        header.iteration = context_.iteration;
+        header.best_fitness = context_.best_fitness;
+        header.worst_fitness = context_.worst_fitness;
+        header.best_x = context_.best_position.x;
+        header.best_y = context_.best_position.y;
+
+        const auto arrays = agents_.GetStateArrays();
+        for (uint32_t a = 0; a < arrays.size(); ++a) {
+            snapshot.Add(snapshot::GetAgentSection(a), arrays[a]->data(), arrays[a]->size() * sizeof(float));
+        }
+        trail_map_.CopyTo(static_cast<float*>(snapshot.Add(snapshot::TRAIL, trail_map_.GetSize() * sizeof(float))));
+        snapshot.Add(snapshot::FOOD, food_positions_.data(), food_positions_.size() * sizeof(Vector2f));
+        snapshot.Add(snapshot::AGENT_ID, agents_.GetIds().data(), agents_.GetIds().size() * sizeof(uint32_t));
+        float* headings = static_cast<float*>(snapshot.Add(snapshot::AGENT_HEADING, agents_.Size() * sizeof(float)));
+        for (size_t i = 0; i < agents_.Size(); ++i) headings[i] = agents_.GetHeading(i);
+        if (!obstacles_.IsEmpty()) {
+            snapshot.Add(snapshot::WALL_BITS, obstacles_.GetBits().data(), obstacles_.GetBits().size() * sizeof(uint64_t));
+            snapshot.Add(snapshot::WALL_DISTANCE, obstacles_.GetDistanceField().data(), obstacles_.GetDistanceField().size() * sizeof(float));
+        }
+    }
+
+    // Starts (or stops) watching the trail map for convergence; see IsConverged.
+    void TrackConvergence(bool is_tracking) {
+        convergence_ = ConvergenceState();
+        convergence_.is_tracking = is_tracking;
+        trail_reference_.clear();
+    }
+
+    bool IsConverged() const { return convergence_.is_converged; }
+    const ConvergenceState& GetConvergence() const { return convergence_; }
+
+    const Settings& GetSettings() const { return settings_; }
+    const SimulationContext& GetContext() const { return context_; }
+    const TrailMap& GetTrailMap() const { return trail_map_; }
+    const AgentPool& GetAgents() const { return agents_; }
+    const ObstacleMap& GetObstacles() const { return obstacles_; }
+    const std::vector<Vector2f>& GetFood() const { return food_positions_; }
+    unsigned long long GetStepCount() const { return step_count_; }
+    // Sum of the population over all steps; less than steps times agents once agents retire.
+    unsigned long long GetAgentSteps() const { return agent_steps_; }
+    unsigned GetThreadCount() const { return thread_pool_.GetThreadCount(); }
+    const ReorderStats& GetReorderStats() const { return reorder_stats_; }
+
+private:
+    Settings settings_;
+    SimulationContext context_;
+    ThreadPool thread_pool_;
+    Decomposition* decomposition_ = nullptr;
+    std::vector<UpdateBuffer> update_buffers_;
+    std::vector<uint32_t> deposits_;
+    DepositSplatter splatter_;
+    std::vector<Vector2f> partners_;
+    TrailMap trail_map_;
+    AgentPool agents_;
+    std::vector<Vector2f> food_positions_;
+    FoodMap food_map_;
+    ObstacleMap obstacles_;
+    bool is_food_map_stale_ = true;
+    unsigned long long step_count_ = 0;
+    unsigned long long agent_steps_ = 0;
+    float step_best_fitness_ = std::numeric_limits<float>::max();
+
+    RadixSorter sorter_;
+    std::vector<uint32_t> sort_keys_;
+    std::vector<uint32_t> sort_order_;
+    std::vector<unsigned long long> task_misses_;
+    ReorderStats reorder_stats_;
+
+    std::unique_ptr<TrajectoryRecorder> trajectory_;
+
+    ConvergenceState convergence_;
+    std::vector<float> trail_reference_;
+    std::vector<float> trail_blocks_;
+    std::vector<uint8_t> settled_blocks_;
+    std::vector<std::array<double, 2>> weight_moments_;
+    std::vector<uint8_t> keep_;
+    std::vector<std::pair<uint32_t, uint32_t>> retiring_;   // id and slot
+
+    void LoadMaze() {
+        if (!settings_.maze_file.empty()) {
+            if (obstacles_.Load(settings_.maze_file, context_.width, context_.height, thread_pool_)) return;
+            std::cerr << "Error loading maze '" << settings_.maze_file << "', using the built-in one\n";
+        }
+        obstacles_.BuildBuiltIn(context_.width, context_.height, thread_pool_);
+    }
+
+    void OpenTrajectory() {
+        trajectory_ = std::make_unique<TrajectoryRecorder>(settings_.trajectory_path, context_.width, context_.height,
+            agents_.Size(), settings_.trajectory_every);
+        if (trajectory_->IsOpen()) return;
+        std::cerr << "Error writing trajectory '" << settings_.trajectory_path << "'\n";
+        trajectory_.reset();
+    }
+
+    bool OpenSnapshot(SnapshotFile& snapshot) {
+        if (snapshot.Open(settings_.resume_path)) return true;
+        std::cerr << "Error loading snapshot '" << settings_.resume_path << "', starting from scratch\n";
+        return false;
+    }
+
+    // The sizes were checked when the file was opened.
+    void RestoreSnapshot(const SnapshotFile& snapshot) {
+        const SnapshotHeader& header = snapshot.GetHeader();
+        const auto arrays = agents_.GetStateArrays();
+        for (uint32_t a = 0; a < arrays.size(); ++a) snapshot.Copy(snapshot::GetAgentSection(a), arrays[a]->data());
+        if (snapshot.Find(snapshot::AGENT_COS_HEADING).size == 0) {
+            agents_.SetHeadings(reinterpret_cast<const float*>(snapshot.Find(snapshot::AGENT_HEADING).data));
+        }
+        snapshot.Copy(snapshot::AGENT_ID, agents_.GetIds().data());
+        trail_map_.CopyFrom(reinterpret_cast<const float*>(snapshot.Find(snapshot::TRAIL).data));
+
+        const SnapshotFile::SectionView food = snapshot.Find(snapshot::FOOD);
+        food_positions_.resize(food.size / sizeof(Vector2f));
+        snapshot.Copy(snapshot::FOOD, food_positions_.data());
+
+        if (context_.is_maze) {
+            obstacles_.Restore(header.width, header.height, snapshot.Find(snapshot::WALL_BITS).data,
+                snapshot.Find(snapshot::WALL_DISTANCE).data);
+        }
+
+        step_count_ = header.step_count;
+        context_.iteration = header.iteration;
+        context_.best_fitness = header.best_fitness;
+        context_.worst_fitness = header.worst_fitness;
+        context_.best_position = { header.best_x, header.best_y };
+    }
+
+    void StepOnce() {
+        SLIME_TRACE_SCOPE("step");
+
+        // Several food edits between two steps cost a single rebuild.
+        if (is_food_map_stale_) {
+            SLIME_TRACE_SCOPE("food_map");
+            food_map_.Rebuild(food_positions_, context_.width, context_.height, thread_pool_);
+            is_food_map_stale_ = false;
+        }
+
+        agent_steps_ += agents_.Size();
+        UpdateAgents();
+        if (!food_positions_.empty() && context_.iteration < context_.max_iteration) ++context_.iteration;
+        else context_.iteration = 1;
+
+        // Food deposits may have landed in the halo; without food it is still current.
+        if (decomposition_) {
+            SLIME_TRACE_SCOPE("exchange");
+            decomposition_->MigrateAgents(agents_);
+            if (!food_positions_.empty()) decomposition_->ExchangeHalo(trail_map_);
+        }
+
+        {
+            SLIME_TRACE_SCOPE("diffuse");
+            SLIME_PERF_SCOPE(perf::DIFFUSE);
+            if (decomposition_) {
+                trail_map_.Diffuse(context_.decay_rate, context_.blur_strength, context_.blur, thread_pool_,
+                    decomposition_->GetFirstTileRow(), decomposition_->GetEndTileRow());
+            }
+            else {
+                trail_map_.Diffuse(context_.decay_rate, context_.blur_strength, context_.blur, thread_pool_);
+            }
+        }
+        DrawAgents();
+        if (decomposition_) {
+            SLIME_TRACE_SCOPE("exchange");
+            decomposition_->ExchangeHalo(trail_map_);
+        }
+        ++step_count_;
+
+        if (trajectory_ && step_count_ % settings_.trajectory_every == 0) {
+            SLIME_TRACE_SCOPE("trajectory");
+            trajectory_->Record(step_count_, agents_, thread_pool_);
+        }
+
+        if (settings_.reorder_every != 0 && step_count_ % settings_.reorder_every == 0) ReorderAgents();
+        if ((convergence_.is_tracking || settings_.adaptive_population) && step_count_ % simulation::CONVERGENCE_CHECK_EVERY == 0) {
+            UpdateConvergence();
+            if (settings_.adaptive_population) RetireSettledAgents();
+        }
+    }
+
+    void UpdateConvergence() {
+        ConvergenceState& state = convergence_;
+        state.trail_change = MeasureTrailChange();
+        state.weight_variance = MeasureWeightVariance();
+        const bool has_fitness = step_best_fitness_ < std::numeric_limits<float>::max();
+        state.best_fitness_change = has_fitness && state.checks != 0
+            ? std::abs(step_best_fitness_ - state.best_fitness) / std::max(std::abs(state.best_fitness), std::numeric_limits<float>::epsilon())
+            : 0.0f;
+        state.best_fitness = has_fitness ? step_best_fitness_ : 0.0f;
+        if (state.checks++ == 0) return;
+
+        state.smoothed_trail_change = state.checks == 2 ? state.trail_change
+            : state.smoothed_trail_change + simulation::CONVERGENCE_SMOOTHING * (state.trail_change - state.smoothed_trail_change);
+        if (state.smoothed_trail_change < state.lowest_trail_change * (1.0f - simulation::CONVERGENCE_MIN_IMPROVEMENT)) {
+            state.lowest_trail_change = state.smoothed_trail_change;
+            state.stalled_checks = 0;
+        }
+        else if (++state.stalled_checks >= simulation::CONVERGENCE_PATIENCE) {
+            state.is_converged = true;
+        }
+    }
+
+    // Relative L1 change of the block sums since the previous call; 1 on the first call.
+    float MeasureTrailChange() {
+        SLIME_TRACE_SCOPE("trail_change");
+        const unsigned block = simulation::TRAIL_BLOCK;
+        const size_t blocks_x = (context_.width + block - 1) / block;
+        const size_t blocks_y = (context_.height + block - 1) / block;
+        trail_blocks_.assign(blocks_x * blocks_y, 0.0f);
+
+        if (trail_map_.IsSparse()) {
+            SumLiveTileBlocks(blocks_x);
+        }
+        else {
+            thread_pool_.ParallelFor(blocks_y, 1, [&](size_t begin, size_t end) {
+                for (size_t by = begin; by < end; ++by) {
+                    float* row_blocks = &trail_blocks_[by * blocks_x];
+                    const unsigned y_end = std::min<unsigned>(context_.height, static_cast<unsigned>((by + 1) * block));
+                    for (unsigned y = static_cast<unsigned>(by * block); y < y_end; ++y) {
+                        for (unsigned x = 0; x < context_.width; ++x) row_blocks[x / block] += trail_map_.GetValue(x, y);
+                    }
+                }
+                });
+        }
+
+        float change = 1.0f;
+        settled_blocks_.assign(trail_blocks_.size(), 0);
+        if (trail_reference_.size() == trail_blocks_.size()) {
+            double difference = 0.0, total = 0.0;
+            for (size_t i = 0; i < trail_blocks_.size(); ++i) {
+                const float block_difference = std::abs(trail_blocks_[i] - trail_reference_[i]);
+                difference += block_difference;
+                total += trail_blocks_[i];
+                settled_blocks_[i] = trail_reference_[i] > 0.0f && block_difference < simulation::ADAPTIVE_SETTLED_CHANGE * trail_reference_[i];
+            }
+            change = total > 0.0 ? static_cast<float>(difference / total) : 0.0f;
+        }
+        trail_reference_.swap(trail_blocks_);
+        return change;
+    }
+
+    // The block sums of a sparse map from its live tiles alone; a missing tile adds nothing.
+    // Blocks lie within one tile and are summed in the same pixel order as the dense pass,
+    // so the sums are the same.
+    void SumLiveTileBlocks(size_t blocks_x) {
+        static_assert(TiledField::TILE % simulation::TRAIL_BLOCK == 0, "a trail block must not straddle tiles");
+        const unsigned block = simulation::TRAIL_BLOCK;
+        const TiledField& tiles = trail_map_.GetTiles();
+        thread_pool_.Run(tiles.GetTileRows(), [&](size_t ty) {
+            const unsigned y0 = static_cast<unsigned>(ty) * TiledField::TILE;
+            const unsigned rows = std::min(TiledField::TILE, context_.height - y0);
+            for (unsigned tx = 0; tx < tiles.GetTileColumns(); ++tx) {
+                const float* tile = tiles.GetTile(tx, static_cast<unsigned>(ty));
+                if (!tile) continue;
+                const unsigned x0 = tx * TiledField::TILE;
+                const unsigned columns = std::min(TiledField::TILE, context_.width - x0);
+                for (unsigned y = 0; y < rows; ++y) {
+                    float* row_blocks = &trail_blocks_[(y0 + y) / block * blocks_x];
+                    const float* values = tile + static_cast<size_t>(y) * TiledField::TILE;
+                    for (unsigned x = 0; x < columns; ++x) row_blocks[(x0 + x) / block] += values[x];
+                }
+            }
+            });
+    }
+
+    // Summed per fixed-size task in task order, so it does not depend on the thread count.
+    float MeasureWeightVariance() {
+        const size_t count = agents_.Size();
+        if (count == 0 || food_positions_.empty()) return 0.0f;
+        weight_moments_.resize((count + simulation::AGENTS_PER_TASK - 1) / simulation::AGENTS_PER_TASK);
+        thread_pool_.Run(weight_moments_.size(), [&](size_t task) {
+            double sum = 0.0, square_sum = 0.0;
+            const size_t begin = task * simulation::AGENTS_PER_TASK;
+            const size_t end = std::min(count, begin + simulation::AGENTS_PER_TASK);
+            for (size_t i = begin; i < end; ++i) {
+                const double weight = agents_.GetWeight(i);
+                sum += weight;
+                square_sum += weight * weight;
+            }
+            weight_moments_[task] = { sum, square_sum };
+            });
+
+        double sum = 0.0, square_sum = 0.0;
+        for (const auto& moments : weight_moments_) {
+            sum += moments[0];
+            square_sum += moments[1];
+        }
+        const double mean = sum / count;
+        return static_cast<float>(std::max(0.0, square_sum / count - mean * mean));
+    }
+
+    // Drops a share of the agents standing in blocks the last check found settled. The
+    // network there holds with fewer agents; should it fade, the block is no longer settled
+    // and stops losing agents. Draws are keyed by agent id and, near the floor, the lowest
+    // ids retire first, so the choice depends on neither the agents' order nor the thread count.
+    void RetireSettledAgents() {
+        SLIME_TRACE_SCOPE("retire");
+        const size_t floor = static_cast<size_t>(std::ceil(context_.num_agents * simulation::ADAPTIVE_MIN_AGENTS));
+        if (agents_.Size() <= floor) return;
+
+        const unsigned block = simulation::TRAIL_BLOCK;
+        const size_t blocks_x = (context_.width + block - 1) / block;
+        const RandomStream random(settings_.seed, step_count_);
+        retiring_.clear();
+        for (size_t i = 0; i < agents_.Size(); ++i) {
+            const Vector2f position = agents_.GetPos(i);
+            const size_t x = static_cast<size_t>(std::clamp(position.x, 0.0f, static_cast<float>(context_.width - 1)));
+            const size_t y = static_cast<size_t>(std::clamp(position.y, 0.0f, static_cast<float>(context_.height - 1)));
+            if (!settled_blocks_[y / block * blocks_x + x / block]) continue;
+            if (random.Uniform(agents_.GetId(i), draw::RETIRE) >= simulation::ADAPTIVE_RETIRE_RATE) continue;
+            retiring_.push_back({ agents_.GetId(i), static_cast<uint32_t>(i) });
+        }
+        if (retiring_.empty()) return;
+
+        const size_t allowed = agents_.Size() - floor;
+        if (retiring_.size() > allowed) {
+            std::nth_element(retiring_.begin(), retiring_.begin() + allowed, retiring_.end());
+            retiring_.resize(allowed);
+        }
+        keep_.assign(agents_.Size(), 1);
+        for (const auto& [id, slot] : retiring_) keep_[slot] = 0;
+        agents_.Compact(keep_);
+    }
+
+    // Agents are split into fixed-size tasks, so the merge order and therefore the
+    // result do not depend on how many threads run them.
+    void UpdateAgents() {
+        const size_t count = agents_.Size();
+        const size_t task_count = (count + simulation::AGENTS_PER_TASK - 1) / simulation::AGENTS_PER_TASK;
+        update_buffers_.resize(task_count);
+
+        RunAgentTasks([&](size_t begin, size_t end, UpdateBuffer& buffer) {
+            SLIME_TRACE_SCOPE("evaluate");
+            buffer.Reset();
+            agents_.Evaluate(begin, end, food_map_, buffer);
+            });
+        ReduceFitness();
+
+        const FitnessRange range = { context_.best_fitness, context_.worst_fitness };
+        const RandomStream random(settings_.seed, step_count_ + 1);
+        if (decomposition_ && !food_positions_.empty()) {
+            SLIME_TRACE_SCOPE("partners");
+            agents_.SetPartners(decomposition_->GatherPartners(agents_, random, partners_) ? &partners_ : nullptr);
+        }
+        RunAgentTasks([&](size_t begin, size_t end, UpdateBuffer& buffer) {
+            SLIME_TRACE_SCOPE("move");
+            agents_.Move(begin, end, trail_map_, food_map_, obstacles_, range, random, buffer);
+            });
+        agents_.SwapPositions();
+
+        SLIME_TRACE_SCOPE("food_deposit");
+        SLIME_PERF_SCOPE(perf::DEPOSIT);
+        deposits_.clear();
+        deposits_.reserve(agents_.Size());
+        for (const auto& buffer : update_buffers_) deposits_.insert(deposits_.end(), buffer.deposits.begin(), buffer.deposits.end());
+        if (decomposition_ && !food_positions_.empty()) decomposition_->RouteDeposits(deposits_);
+        splatter_.Splat(deposits_.size(), [&](size_t k) { return deposits_[k]; }, simulation::FOOD_DEPOSIT,
+            trail_map_, thread_pool_);
+    }
+
+    template <typename Body>
+    void RunAgentTasks(const Body& body) {
+        const size_t count = agents_.Size();
+        thread_pool_.Run(update_buffers_.size(), [&](size_t task) {
+            const size_t begin = task * simulation::AGENTS_PER_TASK;
+            body(begin, std::min(count, begin + simulation::AGENTS_PER_TASK), update_buffers_[task]);
+            });
+    }
+
+    void ReduceFitness() {
+        SLIME_TRACE_SCOPE("reduce");
+        FitnessRange step_range = { std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest() };
+        float best_agent_fitness = std::numeric_limits<float>::max();
+        Vector2f best_position;
+        for (const auto& buffer : update_buffers_) {
+            step_range.best = std::min(step_range.best, buffer.range.best);
+            step_range.worst = std::max(step_range.worst, buffer.range.worst);
+            if (buffer.best_agent_fitness < best_agent_fitness) {
+                best_agent_fitness = buffer.best_agent_fitness;
+                best_position = buffer.best_position;
+            }
+        }
+        if (decomposition_) decomposition_->ReduceFitness(step_range, best_agent_fitness, best_position);
+        step_best_fitness_ = step_range.best;
+
+        context_.best_fitness = std::min(context_.best_fitness, step_range.best);
+        context_.worst_fitness = std::max(context_.worst_fitness, step_range.worst);
+        if (best_agent_fitness < std::numeric_limits<float>::max()) context_.best_position = best_position;
+    }
+
+    void ReorderAgents() {
+        SLIME_TRACE_SCOPE("reorder");
+        const size_t count = agents_.Size();
+        sort_keys_.resize(count);
+        thread_pool_.ParallelFor(count, 1 << 16, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                const Vector2f position = agents_.GetPos(i);
+                const uint32_t x = static_cast<uint32_t>(std::clamp(position.x, 0.0f, static_cast<float>(context_.width - 1)));
+                const uint32_t y = static_cast<uint32_t>(std::clamp(position.y, 0.0f, static_cast<float>(context_.height - 1)));
+                sort_keys_[i] = MortonCode(x, y);
+            }
+            });
+
+        reorder_stats_.misses_before += CountTrailMisses();
+        sorter_.Sort(sort_keys_, sort_order_, thread_pool_);
+        agents_.Permute(sort_order_, thread_pool_);
+        reorder_stats_.misses_after += CountTrailMisses();
+        ++reorder_stats_.passes;
+    }
+
+    unsigned long long CountTrailMisses() {
+        constexpr size_t LINE_BYTES = 64;
+        constexpr size_t CACHE_LINES = 32 * 1024 / LINE_BYTES;
+
+        const size_t count = agents_.Size();
+        task_misses_.resize((count + simulation::AGENTS_PER_TASK - 1) / simulation::AGENTS_PER_TASK);
+        thread_pool_.Run(task_misses_.size(), [&](size_t task) {
+            std::array<size_t, CACHE_LINES> tags;
+            tags.fill(std::numeric_limits<size_t>::max());
+
+            unsigned long long misses = 0;
+            const size_t begin = task * simulation::AGENTS_PER_TASK;
+            const size_t end = std::min(count, begin + simulation::AGENTS_PER_TASK);
+            for (size_t i = begin; i < end; ++i) {
+                const Vector2f position = agents_.GetPos(i);
+                const size_t x = static_cast<size_t>(std::clamp(position.x, 0.0f, static_cast<float>(context_.width - 1)));
+                const size_t y = static_cast<size_t>(std::clamp(position.y, 0.0f, static_cast<float>(context_.height - 1)));
+                const size_t line = (y * context_.width + x) * sizeof(float) / LINE_BYTES;
+                if (tags[line % CACHE_LINES] != line) {
+                    tags[line % CACHE_LINES] = line;
+                    ++misses;
+                }
+            }
+            task_misses_[task] = misses;
+            });
+        return std::accumulate(task_misses_.begin(), task_misses_.end(), 0ull);
+    }
+
+    void DrawAgents() {
+        SLIME_TRACE_SCOPE("agent_deposit");
+        SLIME_PERF_SCOPE(perf::DEPOSIT);
+        const auto pixel_of = [&](size_t i) {
+            const Vector2f position = agents_.GetPos(i);
+            if (position.x < 0 || position.y < 0 || position.x >= context_.width || position.y >= context_.height) {
+                return DepositSplatter::SKIP;
+            }
+            return static_cast<uint32_t>(position.y) * context_.width + static_cast<uint32_t>(position.x);
+        };
+        splatter_.Splat(agents_.Size(), pixel_of, simulation::AGENT_DEPOSIT, trail_map_, thread_pool_);
+    }
+};
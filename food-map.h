@@ -0,0 +1,204 @@
+#pragma once
+#include "domain.h"
+#include "parallel.h"
+
+// Nearest and second nearest food source for every pixel, so an agent finds its food
+// with one lookup instead of scanning the food list. The nearest labels come from jump
+// flooding (with one extra step-1 pass); the second nearest is searched among the
+// Voronoi neighbours of the nearest one. Rebuilt only when the food list changes.
+class FoodMap {
+public:
+    static constexpr int32_t NONE = -1;
+
+    struct Entry {
+        int32_t nearest;
+        int32_t second;
+    };
+
+    void Rebuild(const std::vector<Vector2f>& food, unsigned width, unsigned height, ThreadPool& pool) {
+        width_ = width;
+        height_ = height;
+        food_ = food;
+
+        // Without food nothing looks the map up, and a large world would not afford it.
+        const size_t size = static_cast<size_t>(width) * height;
+        if (food_.empty() || size == 0) {
+            nearest_ = std::vector<int32_t>();
+            second_ = std::vector<int32_t>();
+            return;
+        }
+        nearest_.assign(size, NONE);
+        second_.assign(size, NONE);
+
+        Seed();
+
+        unsigned step = 1;
+        while (step * 2 < std::max(width_, height_)) step *= 2;
+        for (; step >= 1; step /= 2) {
+            JumpFlood(step, pool);
+        }
+        JumpFlood(1, pool);
+
+        BuildNeighbours(pool);
+        FindSecondNearest(pool);
+    }
+
+    bool IsEmpty() const { return food_.empty(); }
+    const Vector2f& GetFood(int32_t label) const { return food_[label]; }
+
+    Entry Lookup(const Vector2f& position) const {
+        const unsigned x = static_cast<unsigned>(std::clamp(position.x, 0.0f, static_cast<float>(width_ - 1)));
+        const unsigned y = static_cast<unsigned>(std::clamp(position.y, 0.0f, static_cast<float>(height_ - 1)));
+        const size_t i = static_cast<size_t>(y) * width_ + x;
+        return { nearest_[i], second_[i] };
+    }
+
+private:
+    static constexpr size_t ROWS_PER_TASK = 16;
+
+    unsigned width_ = 0;
+    unsigned height_ = 0;
+    std::vector<Vector2f> food_;
+    std::vector<int32_t> nearest_;
+    std::vector<int32_t> second_;
+    std::vector<size_t> neighbour_offsets_;
+    std::vector<int32_t> neighbours_;
+    std::vector<std::vector<std::pair<int32_t, int32_t>>> band_edges_;
+
+    float DistanceSquared(int32_t label, unsigned x, unsigned y) const {
+        const float dx = food_[label].x - (x + 0.5f);
+        const float dy = food_[label].y - (y + 0.5f);
+        return dx * dx + dy * dy;
+    }
+
+    // Ties go to the lower label, so the map does not depend on the order pixels are visited in.
+    bool IsCloser(int32_t label, int32_t best, float distance, float best_distance) const {
+        return best == NONE || distance < best_distance || (distance == best_distance && label < best);
+    }
+
+    size_t PixelOf(const Vector2f& position) const {
+        const unsigned x = static_cast<unsigned>(std::clamp(position.x, 0.0f, static_cast<float>(width_ - 1)));
+        const unsigned y = static_cast<unsigned>(std::clamp(position.y, 0.0f, static_cast<float>(height_ - 1)));
+        return static_cast<size_t>(y) * width_ + x;
+    }
+
+    void Seed() {
+        for (int32_t label = 0; label < static_cast<int32_t>(food_.size()); ++label) {
+            const size_t i = PixelOf(food_[label]);
+            const unsigned x = static_cast<unsigned>(i % width_);
+            const unsigned y = static_cast<unsigned>(i / width_);
+            const int32_t current = nearest_[i];
+            if (current == NONE || IsCloser(label, current, DistanceSquared(label, x, y), DistanceSquared(current, x, y))) {
+                nearest_[i] = label;
+            }
+        }
+    }
+
+    // One jump flooding pass from nearest_ into second_, which is free until the end.
+    void JumpFlood(unsigned step, ThreadPool& pool) {
+        const int offset = static_cast<int>(step);
+        pool.ParallelFor(height_, ROWS_PER_TASK, [&](size_t y_begin, size_t y_end) {
+            for (size_t y = y_begin; y < y_end; ++y) {
+                for (unsigned x = 0; x < width_; ++x) {
+                    int32_t best = nearest_[y * width_ + x];
+                    float best_distance = best == NONE ? 0.0f : DistanceSquared(best, x, static_cast<unsigned>(y));
+                    for (int dy = -offset; dy <= offset; dy += offset) {
+                        const int ny = static_cast<int>(y) + dy;
+                        if (ny < 0 || ny >= static_cast<int>(height_)) continue;
+                        for (int dx = -offset; dx <= offset; dx += offset) {
+                            const int nx = static_cast<int>(x) + dx;
+                            if (nx < 0 || nx >= static_cast<int>(width_)) continue;
+
+                            const int32_t label = nearest_[static_cast<size_t>(ny) * width_ + nx];
+                            if (label == NONE || label == best) continue;
+
+                            const float distance = DistanceSquared(label, x, static_cast<unsigned>(y));
+                            if (IsCloser(label, best, distance, best_distance)) {
+                                best = label;
+                                best_distance = distance;
+                            }
+                        }
+                    }
+                    second_[y * width_ + x] = best;
+                }
+            }
+            });
+        nearest_.swap(second_);
+    }
+
+    // Food sources whose regions touch, as a compressed adjacency list.
+    void BuildNeighbours(ThreadPool& pool) {
+        const size_t task_count = (height_ + ROWS_PER_TASK - 1) / ROWS_PER_TASK;
+        band_edges_.resize(task_count);
+
+        pool.Run(task_count, [&](size_t task) {
+            auto& edges = band_edges_[task];
+            edges.clear();
+            const auto add_edge = [&](int32_t a, int32_t b) {
+                if (a == b) return;
+                const std::pair<int32_t, int32_t> edge = { std::min(a, b), std::max(a, b) };
+                if (edges.empty() || edges.back() != edge) edges.push_back(edge);
+            };
+
+            const size_t y_begin = task * ROWS_PER_TASK;
+            const size_t y_end = std::min<size_t>(height_, y_begin + ROWS_PER_TASK);
+            for (size_t y = y_begin; y < y_end; ++y) {
+                const int32_t* row = nearest_.data() + y * width_;
+                for (unsigned x = 0; x + 1 < width_; ++x) add_edge(row[x], row[x + 1]);
+                if (y + 1 < height_) {
+                    for (unsigned x = 0; x < width_; ++x) add_edge(row[x], row[x + width_]);
+                }
+            }
+            });
+
+        std::vector<std::pair<int32_t, int32_t>> edges;
+        for (const auto& band : band_edges_) edges.insert(edges.end(), band.begin(), band.end());
+
+        // Sources sharing a pixel with a closer one own no region; tie them to the owner.
+        for (int32_t label = 0; label < static_cast<int32_t>(food_.size()); ++label) {
+            const int32_t owner = nearest_[PixelOf(food_[label])];
+            if (owner != label) edges.push_back({ std::min(owner, label), std::max(owner, label) });
+        }
+
+        std::sort(edges.begin(), edges.end());
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+        neighbour_offsets_.assign(food_.size() + 1, 0);
+        for (const auto& [a, b] : edges) {
+            ++neighbour_offsets_[a + 1];
+            ++neighbour_offsets_[b + 1];
+        }
+        std::partial_sum(neighbour_offsets_.begin(), neighbour_offsets_.end(), neighbour_offsets_.begin());
+
+        neighbours_.resize(edges.size() * 2);
+        std::vector<size_t> fill(neighbour_offsets_.begin(), neighbour_offsets_.end() - 1);
+        for (const auto& [a, b] : edges) {
+            neighbours_[fill[a]++] = b;
+            neighbours_[fill[b]++] = a;
+        }
+    }
+
+    // The second nearest source of a point is always a Voronoi neighbour of the nearest one.
+    void FindSecondNearest(ThreadPool& pool) {
+        pool.ParallelFor(height_, ROWS_PER_TASK, [&](size_t y_begin, size_t y_end) {
+            for (size_t y = y_begin; y < y_end; ++y) {
+                for (unsigned x = 0; x < width_; ++x) {
+                    const size_t i = y * width_ + x;
+                    const int32_t nearest = nearest_[i];
+
+                    int32_t best = NONE;
+                    float best_distance = 0.0f;
+                    for (size_t n = neighbour_offsets_[nearest]; n < neighbour_offsets_[nearest + 1]; ++n) {
+                        const int32_t label = neighbours_[n];
+                        const float distance = DistanceSquared(label, x, static_cast<unsigned>(y));
+                        if (IsCloser(label, best, distance, best_distance)) {
+                            best = label;
+                            best_distance = distance;
+                        }
+                    }
+                    second_[i] = best;
+                }
+            }
+            });
+    }
+};
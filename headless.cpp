@@ -0,0 +1,171 @@
+#include "domain.h"
+#include "framework.h"
+#include "engine.h"
+#include "allocation-counter.h"
+
+#include <chrono>
+
+// FNV-1a over agent state and the trail map, to compare runs bit for bit.
+uint64_t StateChecksum(const Engine& engine) {
+    uint64_t hash = 14695981039346656037ull;
+    const auto mix = [&](const void* data, size_t size) {
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+    };
+
+    const AgentPool& agents = engine.GetAgents();
+    for (size_t i = 0; i < agents.Size(); ++i) {
+        const Vector2f position = agents.GetPos(i);
+        const float values[] = { position.x, position.y, agents.GetHeading(i), agents.GetWeight(i) };
+        mix(values, sizeof(values));
+    }
+
+    const TrailMap& trail_map = engine.GetTrailMap();
+    std::vector<float> row(trail_map.GetWidth());
+    for (unsigned y = 0; y < trail_map.GetHeight(); ++y) {
+        trail_map.CopyRow(y, row.data());
+        mix(row.data(), row.size() * sizeof(float));
+    }
+    return hash;
+}
+
+// Runs the first half of the steps to warm up, then counts the allocations of the rest.
+bool CheckAllocations(const Settings& settings) {
+    Engine engine(settings);
+    const unsigned warmup = settings.steps / 2;
+    engine.Step(warmup);
+    allocation::Start();
+    engine.Step(settings.steps - warmup);
+    const unsigned long long allocations = allocation::Stop();
+
+    std::cout << "Allocations in steps " << warmup << " to " << settings.steps << ": " << allocations << "\n";
+    return allocations == 0;
+}
+
+double RunSteps(const Settings& settings, bool is_verbose) {
+    const auto setup_start = std::chrono::steady_clock::now();
+    Engine engine(settings);
+    const std::chrono::duration<double> setup_time = std::chrono::steady_clock::now() - setup_start;
+
+    const SimulationContext& context = engine.GetContext();
+    if (is_verbose) {
+        std::cout << "Frame " << context.width << "x" << context.height
+            << ", agents " << context.num_agents
+            << " (" << AgentPool::BYTES_PER_AGENT << " bytes each)"
+            << ", food " << engine.GetFood().size()
+            << ", threads " << engine.GetThreadCount()
+            << ", setup " << setup_time.count() << " s\n";
+    }
+
+    trace::ENABLED.store(!settings.trace_path.empty(), std::memory_order_relaxed);
+    perf::ENABLED = settings.perf && is_verbose;
+    const auto start = std::chrono::steady_clock::now();
+    unsigned long long steps = 0;
+    if (settings.until_converged) {
+        engine.TrackConvergence(true);
+        for (; steps < settings.steps && !engine.IsConverged(); ++steps) engine.Step();
+    }
+    else {
+        engine.Step(settings.steps);
+        steps = settings.steps;
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    const double steps_per_second = elapsed.count() > 0 ? steps / elapsed.count() : 0.0;
+    if (is_verbose) {
+        const ConvergenceState& convergence = engine.GetConvergence();
+        if (settings.until_converged) {
+            std::cout << (engine.IsConverged() ? "Converged" : "Not converged") << " at step " << engine.GetStepCount()
+                << ", trail change " << convergence.trail_change
+                << ", best fitness change " << convergence.best_fitness_change
+                << ", weight variance " << convergence.weight_variance << "\n";
+        }
+        if (settings.adaptive_population && steps != 0) {
+            std::cout << "Active agents " << engine.GetAgents().Size() << " of " << context.num_agents
+                << ", " << 100.0 * engine.GetAgentSteps() / (static_cast<double>(steps) * context.num_agents)
+                << "% of the agent-steps\n";
+        }
+        std::cout << "Steps " << steps
+            << ", time " << elapsed.count() << " s"
+            << ", steps/sec " << steps_per_second
+            << ", agent-steps/sec " << (elapsed.count() > 0 ? engine.GetAgentSteps() / elapsed.count() : 0.0) << "\n"
+            << "Checksum " << std::hex << StateChecksum(engine) << std::dec << "\n";
+
+        const TrailMap& trail_map = engine.GetTrailMap();
+        std::cout << "Trail map " << trail_map.GetMemoryBytes() / (1024.0 * 1024.0) << " MiB";
+        if (trail_map.IsSparse()) {
+            std::cout << ", " << trail_map.GetTiles().GetTileCount() << " of "
+                << ((context.width + TiledField::TILE - 1) / TiledField::TILE) * ((context.height + TiledField::TILE - 1) / TiledField::TILE)
+                << " tiles";
+        }
+        std::cout << "\n";
+
+        const ReorderStats& reorder = engine.GetReorderStats();
+        if (reorder.passes != 0) {
+            std::cout << "Reorder passes " << reorder.passes
+                << ", trail cache misses per pass " << reorder.misses_before / reorder.passes
+                << " -> " << reorder.misses_after / reorder.passes
+                << ", saved " << (static_cast<double>(reorder.misses_before) - reorder.misses_after) / reorder.passes << "\n";
+        }
+
+        if (!settings.snapshot_path.empty()) {
+            Snapshot snapshot;
+            engine.CaptureSnapshot(snapshot);
+            if (WriteSnapshot(snapshot, settings.snapshot_path)) std::cout << "Snapshot written to '" << settings.snapshot_path << "'\n";
+            else std::cerr << "Error writing snapshot '" << settings.snapshot_path << "'\n";
+        }
+
+        if (perf::ENABLED) {
+            std::cout << "Counters per unit and step:\n";
+            perf::WriteReport(std::cout, steps, context.num_agents, static_cast<size_t>(context.width) * context.height);
+        }
+
+        if (trace::ENABLED.load(std::memory_order_relaxed)) {
+            std::cout << "Per step (events still in the trace buffers):\n"
+                << trace::FormatBreakdown(trace::Breakdown(std::numeric_limits<int64_t>::max() / 2), "step");
+            std::ofstream trace_file(settings.trace_path);
+            trace::WriteChromeTrace(trace_file);
+        }
+    }
+    return steps_per_second;
+}
+
+void RunScaling(Settings settings) {
+    const unsigned max_threads = settings.threads != 0 ? settings.threads : std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<unsigned> thread_counts;
+    for (unsigned threads = 1; threads < max_threads; threads *= 2) thread_counts.push_back(threads);
+    thread_counts.push_back(max_threads);
+
+    std::cout << "threads;steps/sec;speedup;efficiency\n";
+    double baseline = 0.0;
+    for (unsigned threads : thread_counts) {
+        settings.threads = threads;
+        const double steps_per_second = RunSteps(settings, false);
+        if (baseline == 0.0) baseline = steps_per_second;
+
+        const double speedup = baseline > 0 ? steps_per_second / baseline : 0.0;
+        std::cout << threads << ";" << steps_per_second << ";" << speedup << ";" << speedup / threads << "\n";
+    }
+}
+
+int main(int argc, char** argv) {
+    Settings settings;
+    if (!ParseSettings(argc, argv, settings)) return EXIT_FAILURE;
+
+    if (settings.check_allocations) {
+        if (settings.seed == 0) settings.seed = static_cast<unsigned>(time(nullptr));
+        return CheckAllocations(settings) ? 0 : EXIT_FAILURE;
+    }
+    if (settings.scaling) {
+        if (settings.seed == 0) settings.seed = static_cast<unsigned>(time(nullptr));
+        RunScaling(settings);
+    }
+    else {
+        RunSteps(settings, true);
+    }
+
+    return 0;
+}
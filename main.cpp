@@ -1,22 +1,30 @@
 ﻿#include "domain.h"
 #include "framework.h"
-#include "agent.h"
+#include "engine.h"
+#include "pipeline.h"
+#include "allocation-counter.h"
 
-int main() {
-    InitiliseConfig();
-    sf::RenderWindow window(sf::VideoMode(config::WIDTH, config::HEIGHT), "Slime Mold");
+#include <SFML/Graphics.hpp>
+#include <SFML/Window.hpp>
+
+sf::Color ToSfColor(const Color& color) {
+    return sf::Color(color.r, color.g, color.b, color.a);
+}
+
+int main(int argc, char** argv) {
+    Settings settings;
+    if (!ParseSettings(argc, argv, settings)) return EXIT_FAILURE;
+    Engine engine(settings);
+    const SimulationContext& context = engine.GetContext();
+
+    sf::RenderWindow window(sf::VideoMode(context.width, context.height), "Slime Mold");
     window.setFramerateLimit(constant::FPS);
 
     sf::Font font;
-    if (!font.loadFromFile("C:/Users/user/source/repos/test/arial.ttf")) {
-        std::cerr << "Error loading font\n";
-        return EXIT_FAILURE;
-    }
-
-    std::pair<sf::Shader, sf::Shader> blur;
-    if (!blur.first.loadFromMemory(shader::HORIZONTAL_BLUR, sf::Shader::Fragment) ||
-        !blur.second.loadFromMemory(shader::VERTICAL_BLUR, sf::Shader::Fragment)) {
-        return EXIT_FAILURE;
+    bool has_font = false;
+    if (!settings.font_path.empty()) {
+        has_font = font.loadFromFile(settings.font_path);
+        if (!has_font) std::cerr << "Error loading font\n";
     }
 
     sf::Text fps_text;
@@ -24,148 +32,94 @@ int main() {
     fps_text.setCharacterSize(20);
     fps_text.setPosition(10, 10);
 
-    sf::RenderTexture trail_map, temp_tex_1, temp_tex_2;
-    trail_map.create(config::WIDTH, config::HEIGHT);
-    temp_tex_1.create(config::WIDTH, config::HEIGHT);
-    temp_tex_2.create(config::WIDTH, config::HEIGHT);
-    trail_map.clear(sf::Color::Black);
-
-    srand(static_cast<unsigned>(time(nullptr)));
-    sf::VertexArray agents_vertices(sf::Points, config::NUM_AGENTS);
-    sf::RenderStates render_states;
-    render_states.blendMode = sf::BlendAdd;
+    // Per-phase times of the last second, toggled with T; needs a font.
+    trace::ENABLED.store(!settings.trace_path.empty(), std::memory_order_relaxed);
+    sf::Text breakdown_text;
+    breakdown_text.setFont(font);
+    breakdown_text.setCharacterSize(14);
+    breakdown_text.setPosition(10, 40);
+    breakdown_text.setFillColor(sf::Color::White);
+    sf::Clock breakdown_clock;
 
-    std::vector<unsigned> rows(config::HEIGHT);
-    std::iota(rows.begin(), rows.end(), 0);
+    sf::Texture trail_texture;
+    trail_texture.create(context.width, context.height);
+    const sf::Sprite trail_sprite(trail_texture);
 
     sf::Clock clock;
     float fps_alpha = 0.1f;
     float smoothed_fps = static_cast<float>(constant::FPS);
     sf::Clock fps_update_clock;
-    std::vector<sf::Vector2f> food_positions;
 
-    std::vector<Agent*> agents;
-    std::vector<Agent> agent_storage;
-    agent_storage.reserve(config::NUM_AGENTS);
-    for (size_t i = 0; i < config::NUM_AGENTS; ++i) {
-        agent_storage.emplace_back(agents);
+    sf::Texture walls_texture;
+    if (context.is_maze) {
+        std::vector<uint8_t> wall_pixels;
+        engine.GetObstacles().ExportRgba(wall_pixels, { 255, 255, 255, 255 });
+        walls_texture.create(context.width, context.height);
+        walls_texture.update(wall_pixels.data());
     }
+    const sf::Sprite walls_sprite(walls_texture);
 
-    agents.reserve(config::NUM_AGENTS);
-    for (auto& agent : agent_storage) {
-        agents.push_back(&agent);
-    }
+    sf::CircleShape food_shape(food::RADIUS);
+    food_shape.setFillColor(ToSfColor(food::COLOR));
+    sf::CircleShape best_pos_shape(food::RADIUS / 2.0f);
+    best_pos_shape.setFillColor(sf::Color::Red);
 
-    sf::RenderTexture walls_texture;
-    walls_texture.create(config::WIDTH, config::HEIGHT);
-    CreateMaze(walls_texture);
+    // With --check-allocations, once ALLOCATION_WARMUP_FRAMES frames have passed without
+    // input, no frame and no step behind it may allocate; input restarts the warm-up.
+    unsigned steady_frames = 0;
+    int exit_status = 0;
 
-    bool is_paused = true;
-    while (window.isOpen()) {
-        sf::Event event;
-        while (window.pollEvent(event)) {
-            if (event.type == sf::Event::Closed || event.key.code == sf::Keyboard::Escape) window.close();
-            if (event.type == sf::Event::KeyPressed) {
-                if (event.key.code == sf::Keyboard::S) {
-                    std::ofstream output_file("agents_data.csv");
-
-                    if (output_file.is_open()) {
-                        output_file << "X;Y;Weight\n";
-
-                        for (const auto& agent : agents) {
-                            float x = agent->GetPos().x;
-                            float y = agent->GetPos().y;
-                            float weight = agent->GetWeight();
-
-                            output_file.precision(16);
-                            output_file << x << ";" << y << ";" << weight << "\n";
-                        }
-
-                        output_file.close();
-                        std::cout << "������ ������� ��������� � agents_data.csv\n";
-                    }
-                    else {
-                        std::cerr << "������ �������� �����!\n";
-                    }
-                }
-                if (event.key.code == sf::Keyboard::Space) {
-                    if (is_paused) is_paused = false;
-                    else is_paused = true;
-                }
-            }
-            if (event.type == sf::Event::MouseButtonPressed) {
-                sf::Vector2f mouse_pos = window.mapPixelToCoords({ event.mouseButton.x, event.mouseButton.y });
+    // Input goes to the simulation as commands and finished frames come back; with
+    // --pipeline the simulation steps on its own thread, unthrottled by the display.
+    // S copies the state and a background thread writes it out.
+    const std::string snapshot_path = settings.snapshot_path.empty() ? "snapshot.slime" : settings.snapshot_path;
+    SimulationRunner simulation(engine, snapshot_path, true, settings.until_converged);
+    if (settings.is_pipelined) simulation.Start();
+
+    unsigned long long last_step = 0;
+    sf::Clock step_rate_clock;
+    float steps_per_second = 0.0f;
 
-                if (event.mouseButton.button == sf::Mouse::Left) {
-                    food_positions.push_back({ mouse_pos.x - food::RADIUS, mouse_pos.y - food::RADIUS });
+    while (window.isOpen()) {
+        SLIME_TRACE_SCOPE("frame");
+
+        bool has_input = false;
+        {
+            SLIME_TRACE_SCOPE("events");
+            // SFML queues events in a std::deque, which is not ours to preallocate.
+            const allocation::Pause pause;
+            sf::Event event;
+            while (window.pollEvent(event)) {
+                has_input |= event.type == sf::Event::KeyPressed || event.type == sf::Event::MouseButtonPressed;
+                if (event.type == sf::Event::Closed || event.key.code == sf::Keyboard::Escape) window.close();
+                if (event.type == sf::Event::KeyPressed) {
+                    if (event.key.code == sf::Keyboard::S) simulation.Post({ SimulationCommand::SNAPSHOT });
+                    if (event.key.code == sf::Keyboard::T) trace::ENABLED.store(!trace::ENABLED.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                    if (event.key.code == sf::Keyboard::Space) simulation.Post({ SimulationCommand::TOGGLE_PAUSE });
+                    if (event.key.code == sf::Keyboard::F) simulation.Post({ SimulationCommand::TOGGLE_FAST_FORWARD });
+                    if (event.key.code == sf::Keyboard::C) simulation.Post({ SimulationCommand::RUN_UNTIL_CONVERGED });
                 }
+                if (event.type == sf::Event::MouseButtonPressed) {
+                    sf::Vector2f mouse_pos = window.mapPixelToCoords({ event.mouseButton.x, event.mouseButton.y });
 
-                if (event.mouseButton.button == sf::Mouse::Right && !food_positions.empty()) {
-                    float min_dist = 25.0f; // ������ ��������
-                    auto closest = std::min_element(food_positions.begin(), food_positions.end(), [&](const sf::Vector2f& a, const sf::Vector2f& b) {
-                        return Distance(mouse_pos, a) < Distance(mouse_pos, b);
-                        });
+                    if (event.mouseButton.button == sf::Mouse::Left) {
+                        simulation.Post({ SimulationCommand::ADD_FOOD, { mouse_pos.x - food::RADIUS, mouse_pos.y - food::RADIUS } });
+                    }
 
-                    if (Distance(mouse_pos, *closest) <= min_dist) {
-                        food_positions.erase(closest);
+                    if (event.mouseButton.button == sf::Mouse::Right) {
+                        float min_dist = 25.0f; // ������ ��������
+                        simulation.Post({ SimulationCommand::REMOVE_FOOD, { mouse_pos.x, mouse_pos.y }, min_dist });
                     }
                 }
             }
         }
-        if (!is_paused) {
-            sf::Image trail_image = trail_map.getTexture().copyToImage();
-            for (auto& agent : agents) {
-                agent->Update(trail_image, food_positions);
-            }
-            if (!food_positions.empty() && simulation::ITER < simulation::MAX_ITERATION) ++simulation::ITER;
-            else simulation::ITER = 1;
-
-            sf::Image img = trail_map.getTexture().copyToImage();
-            std::for_each(std::execution::par, rows.begin(), rows.end(),
-                [&](unsigned y) {
-                    for (unsigned x = 0; x < config::WIDTH; ++x) {
-                        auto pixel = img.getPixel(x, y);
-                        pixel.r = static_cast<sf::Uint8>(pixel.r * simulation::DECAY_RATE);
-                        pixel.g = static_cast<sf::Uint8>(pixel.g * simulation::DECAY_RATE);
-                        pixel.b = static_cast<sf::Uint8>(pixel.b * simulation::DECAY_RATE);
-                        img.setPixel(x, y, pixel);
-                    }
-                });
-
-            sf::Texture decayed_tex;
-            decayed_tex.loadFromImage(img);
-
-            blur.first.setUniform("texture", sf::Shader::CurrentTexture);
-            blur.first.setUniform("offset", simulation::BLUR_STRENGTH / config::WIDTH);
-            temp_tex_1.clear(sf::Color::Transparent);
-            temp_tex_1.draw(sf::Sprite(decayed_tex), &blur.first);
-            temp_tex_1.display();
-
-            blur.second.setUniform("texture", sf::Shader::CurrentTexture);
-            blur.second.setUniform("offset", simulation::BLUR_STRENGTH / config::HEIGHT);
-            temp_tex_2.clear(sf::Color::Transparent);
-            temp_tex_2.draw(sf::Sprite(temp_tex_1.getTexture()), &blur.second);
-            temp_tex_2.display();
-
-            trail_map.clear();
-            trail_map.draw(sf::Sprite(temp_tex_2.getTexture()));
-
-            std::vector<size_t> indices(agents.size());
-            std::iota(indices.begin(), indices.end(), 0);
-            std::for_each(std::execution::par, indices.begin(), indices.end(), [&](size_t i) {
-                agents_vertices[i].position = agents[i]->GetPos();
-                //agents_vertices[i].color = agent::COLOR;
-
-                //agents_vertices[i].color = sf::Color(10, 0, 10);
-
-                agents_vertices[i].color = sf::Color(
-                    10 * agents[i]->GetWeight(),
-                    10 * (1 - agents[i]->GetWeight()),
-                    255
-                );
-                });
-            trail_map.draw(agents_vertices, render_states);
-            trail_map.display();
+        if (!settings.is_pipelined) simulation.Tick();
+
+        const bool is_new_frame = simulation.AcquireFrame();
+        const RenderFrame& frame = simulation.GetFrame();
+        if (is_new_frame) {
+            SLIME_TRACE_SCOPE("texture_update");
+            trail_texture.update(frame.trail_rgba.data());
         }
 
         float delta_time = clock.restart().asSeconds();
@@ -175,31 +129,68 @@ int main() {
         }
 
         if (fps_update_clock.getElapsedTime().asMilliseconds() > 100) {
+            const allocation::Pause pause;
             if (smoothed_fps >= 20) fps_text.setFillColor(sf::Color::Green);
             else fps_text.setFillColor(sf::Color::Red);
-            fps_text.setString("FPS: " + std::to_string(static_cast<int>(smoothed_fps)));
+            fps_text.setString("FPS: " + std::to_string(static_cast<int>(smoothed_fps))
+                + ", steps/s: " + std::to_string(static_cast<int>(steps_per_second))
+                + (frame.is_fast_forward ? ", x" + std::to_string(frame.steps_per_update) : std::string()));
             fps_update_clock.restart();
         }
 
+        if (step_rate_clock.getElapsedTime().asMilliseconds() > 500) {
+            steps_per_second = (frame.step - last_step) / step_rate_clock.restart().asSeconds();
+            last_step = frame.step;
+        }
+
+        if (trace::ENABLED.load(std::memory_order_relaxed) && breakdown_clock.getElapsedTime().asMilliseconds() > 500) {
+            const allocation::Pause pause;
+            breakdown_text.setString(trace::FormatBreakdown(trace::Breakdown(1'000'000'000), "frame"));
+            breakdown_clock.restart();
+        }
 
-        window.clear();
-        window.draw(sf::Sprite(trail_map.getTexture()));
-        if (mode::IS_MAZE) window.draw(sf::Sprite(walls_texture.getTexture()));
+        {
+            SLIME_TRACE_SCOPE("draw");
+            window.clear();
+            window.draw(trail_sprite);
+            if (context.is_maze) window.draw(walls_sprite);
 
-        //window.draw(fps_text);
+            if (has_font) window.draw(fps_text);
+            if (has_font && trace::ENABLED.load(std::memory_order_relaxed)) window.draw(breakdown_text);
 
-        sf::CircleShape food_shape(food::RADIUS);
-        food_shape.setFillColor(food::COLOR);
-        for (const auto& pos : food_positions) {
-            food_shape.setPosition(pos);
-            window.draw(food_shape);
+            for (const auto& pos : frame.food) {
+                food_shape.setPosition(pos.x, pos.y);
+                window.draw(food_shape);
+            }
+            best_pos_shape.setPosition({ frame.best_position.x + best_pos_shape.getRadius(), frame.best_position.y + best_pos_shape.getRadius() });
+            //window.draw(best_pos_shape);
+        }
+
+        {
+            SLIME_TRACE_SCOPE("display");
+            window.display();
+        }
+
+        if (settings.check_allocations) {
+            if (has_input) {
+                allocation::Stop();
+                steady_frames = 0;
+            }
+            else if (++steady_frames == constant::ALLOCATION_WARMUP_FRAMES) {
+                allocation::Start();
+            }
+            else if (steady_frames > constant::ALLOCATION_WARMUP_FRAMES && allocation::Peek() != 0) {
+                std::cerr << "Steady-state frame " << steady_frames - constant::ALLOCATION_WARMUP_FRAMES
+                    << " allocated " << allocation::Stop() << " times\n";
+                exit_status = EXIT_FAILURE;
+                window.close();
+            }
         }
-        sf::CircleShape best_pos_shape(food::RADIUS / 2.0f);
-        best_pos_shape.setPosition({ population::BEST_POSITION.x + best_pos_shape.getRadius(), population::BEST_POSITION.y + best_pos_shape.getRadius() });
-        best_pos_shape.setFillColor(sf::Color::Red);
-        //window.draw(best_pos_shape);
-        window.display();
     }
 
-    return 0;
+    if (!settings.trace_path.empty()) {
+        std::ofstream trace_file(settings.trace_path);
+        trace::WriteChromeTrace(trace_file);
+    }
+    return exit_status;
 }
\ No newline at end of file
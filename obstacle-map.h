@@ -0,0 +1,281 @@
+#pragma once
+#include "domain.h"
+#include "parallel.h"
+
+#include <cstring>
+
+// Walls at simulation resolution: one bit per pixel for collision tests and a signed
+// distance field (positive in free space, negative inside walls) whose gradient gives
+// the wall normal. Loaded from a PGM image, a text grid, or one of the built-in mazes.
+class ObstacleMap {
+public:
+    bool IsEmpty() const { return bits_.empty(); }
+    unsigned GetWidth() const { return width_; }
+    unsigned GetHeight() const { return height_; }
+
+    // Points outside the field are not walls; the border handling takes care of them.
+    bool IsWall(const Vector2f& position) const {
+        if (!(position.x >= 0.0f && position.y >= 0.0f && position.x < width_ && position.y < height_)) return false;
+        return IsWall(static_cast<unsigned>(position.x), static_cast<unsigned>(position.y));
+    }
+
+    bool IsWall(unsigned x, unsigned y) const {
+        return (bits_[static_cast<size_t>(y) * words_per_row_ + x / 64] >> (x % 64)) & 1u;
+    }
+
+    float GetDistance(unsigned x, unsigned y) const {
+        return distance_[static_cast<size_t>(y) * width_ + x];
+    }
+
+    // Unit normal pointing away from the nearest wall, or a zero vector where the field is flat.
+    Vector2f GetNormal(const Vector2f& position) const {
+        const unsigned x = static_cast<unsigned>(std::clamp(position.x, 0.0f, static_cast<float>(width_ - 1)));
+        const unsigned y = static_cast<unsigned>(std::clamp(position.y, 0.0f, static_cast<float>(height_ - 1)));
+        const unsigned left = x > 0 ? x - 1 : x;
+        const unsigned right = x + 1 < width_ ? x + 1 : x;
+        const unsigned top = y > 0 ? y - 1 : y;
+        const unsigned bottom = y + 1 < height_ ? y + 1 : y;
+
+        const Vector2f gradient = {
+            GetDistance(right, y) - GetDistance(left, y),
+            GetDistance(x, bottom) - GetDistance(x, top)
+        };
+        const float length = std::sqrt(gradient.x * gradient.x + gradient.y * gradient.y);
+        if (length == 0.0f) return Vector2f();
+        return (1.0f / length) * gradient;
+    }
+
+    // Cell grid where 1 marks a wall; cells outside the grid are walls as well.
+    void BuildFromCells(const std::vector<std::vector<int>>& cells, float cell_width, float cell_height,
+        unsigned width, unsigned height, ThreadPool& pool) {
+        RasteriseCells(cells, cell_width, cell_height, width, height);
+        BuildDistanceField(pool);
+    }
+
+    // maze::MAZE at maze::CELL_SIZE. The old grid lookup treated the first row and column
+    // as walls whatever they held, and so does this.
+    void BuildBuiltIn(unsigned width, unsigned height, ThreadPool& pool) {
+        auto cells = maze::MAZE;
+        for (auto& row : cells) {
+            if (!row.empty()) row[0] = 1;
+        }
+        if (!cells.empty()) std::fill(cells[0].begin(), cells[0].end(), 1);
+        BuildFromCells(cells, maze::CELL_SIZE, maze::CELL_SIZE, width, height, pool);
+    }
+
+    // Binary or ASCII PGM (dark pixels are walls, scaled to the field), or a text grid
+    // ('1' or '#' are walls, stretched over the field). Returns false if the file is unusable.
+    bool Load(const std::string& path, unsigned width, unsigned height, ThreadPool& pool) {
+        std::ifstream input(path, std::ios::binary);
+        if (!input) return false;
+
+        char magic[2] = {};
+        input.read(magic, 2);
+        if (input && magic[0] == 'P' && (magic[1] == '2' || magic[1] == '5')) {
+            if (!LoadPgm(input, magic[1] == '5', width, height)) return false;
+        }
+        else {
+            input.clear();
+            input.seekg(0);
+            if (!LoadText(input, width, height)) return false;
+        }
+        BuildDistanceField(pool);
+        return true;
+    }
+
+    const std::vector<uint64_t>& GetBits() const { return bits_; }
+    const std::vector<float>& GetDistanceField() const { return distance_; }
+
+    // Walls and distance field as returned by GetBits and GetDistanceField, e.g. from a snapshot.
+    void Restore(unsigned width, unsigned height, const void* bits, const void* distance) {
+        Resize(width, height);
+        std::memcpy(bits_.data(), bits, bits_.size() * sizeof(uint64_t));
+        std::memcpy(distance_.data(), distance, distance_.size() * sizeof(float));
+    }
+
+    // RGBA8 overlay for the viewer: walls in `color`, free space transparent.
+    void ExportRgba(std::vector<uint8_t>& rgba, const Color& color) const {
+        rgba.assign(static_cast<size_t>(width_) * height_ * 4, 0);
+        for (unsigned y = 0; y < height_; ++y) {
+            for (unsigned x = 0; x < width_; ++x) {
+                if (!IsWall(x, y)) continue;
+                uint8_t* pixel = &rgba[(static_cast<size_t>(y) * width_ + x) * 4];
+                pixel[0] = color.r;
+                pixel[1] = color.g;
+                pixel[2] = color.b;
+                pixel[3] = color.a;
+            }
+        }
+    }
+
+private:
+    unsigned width_ = 0;
+    unsigned height_ = 0;
+    size_t words_per_row_ = 0;
+    std::vector<uint64_t> bits_;
+    std::vector<float> distance_;
+
+    void Resize(unsigned width, unsigned height) {
+        width_ = width;
+        height_ = height;
+        words_per_row_ = (width + 63) / 64;
+        bits_.assign(words_per_row_ * height, 0);
+        distance_.assign(static_cast<size_t>(width) * height, 0.0f);
+    }
+
+    void SetWall(unsigned x, unsigned y) {
+        bits_[static_cast<size_t>(y) * words_per_row_ + x / 64] |= uint64_t(1) << (x % 64);
+    }
+
+    void RasteriseCells(const std::vector<std::vector<int>>& cells, float cell_width, float cell_height,
+        unsigned width, unsigned height) {
+        Resize(width, height);
+        const size_t rows = cells.size();
+        for (unsigned y = 0; y < height; ++y) {
+            const size_t cell_y = static_cast<size_t>(y / cell_height);
+            for (unsigned x = 0; x < width; ++x) {
+                const size_t cell_x = static_cast<size_t>(x / cell_width);
+                if (cell_y >= rows || cell_x >= cells[cell_y].size() || cells[cell_y][cell_x] == 1) SetWall(x, y);
+            }
+        }
+    }
+
+    static bool ReadPgmValue(std::istream& input, unsigned& value) {
+        input >> std::ws;
+        while (input.peek() == '#') {
+            input.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+            input >> std::ws;
+        }
+        return static_cast<bool>(input >> value);
+    }
+
+    bool LoadPgm(std::istream& input, bool is_binary, unsigned width, unsigned height) {
+        unsigned image_width = 0, image_height = 0, max_value = 0;
+        if (!ReadPgmValue(input, image_width) || !ReadPgmValue(input, image_height) || !ReadPgmValue(input, max_value)) return false;
+        if (image_width == 0 || image_height == 0 || max_value == 0 || max_value > 65535) return false;
+
+        std::vector<unsigned> image(static_cast<size_t>(image_width) * image_height);
+        if (is_binary) {
+            input.get();
+            const size_t sample_size = max_value < 256 ? 1 : 2;
+            std::vector<uint8_t> raw(image.size() * sample_size);
+            if (!input.read(reinterpret_cast<char*>(raw.data()), raw.size())) return false;
+            for (size_t i = 0; i < image.size(); ++i) {
+                image[i] = sample_size == 1 ? raw[i] : (raw[i * 2] << 8) | raw[i * 2 + 1];
+            }
+        }
+        else {
+            for (auto& value : image) {
+                if (!ReadPgmValue(input, value)) return false;
+            }
+        }
+
+        Resize(width, height);
+        for (unsigned y = 0; y < height; ++y) {
+            const size_t image_y = static_cast<size_t>(y) * image_height / height;
+            for (unsigned x = 0; x < width; ++x) {
+                const size_t image_x = static_cast<size_t>(x) * image_width / width;
+                if (image[image_y * image_width + image_x] * 2 < max_value) SetWall(x, y);
+            }
+        }
+        return true;
+    }
+
+    bool LoadText(std::istream& input, unsigned width, unsigned height) {
+        std::vector<std::vector<int>> cells;
+        std::string line;
+        size_t columns = 0;
+        while (std::getline(input, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty()) continue;
+
+            std::vector<int> row;
+            for (char c : line) {
+                if (c == ' ' || c == '\t' || c == ',') continue;
+                row.push_back(c == '1' || c == '#' ? 1 : 0);
+            }
+            columns = std::max(columns, row.size());
+            cells.push_back(std::move(row));
+        }
+        if (cells.empty() || columns == 0) return false;
+
+        for (auto& row : cells) row.resize(columns, 0);
+
+        RasteriseCells(cells, static_cast<float>(width) / columns, static_cast<float>(height) / cells.size(), width, height);
+        return true;
+    }
+
+    // Exact Euclidean distances via the separable Felzenszwalb-Huttenlocher transform, once to
+    // the nearest wall and once to the nearest free pixel.
+    void BuildDistanceField(ThreadPool& pool) {
+        const size_t size = static_cast<size_t>(width_) * height_;
+        std::vector<float> to_wall(size), to_free(size);
+        for (unsigned y = 0; y < height_; ++y) {
+            for (unsigned x = 0; x < width_; ++x) {
+                const size_t i = static_cast<size_t>(y) * width_ + x;
+                const bool is_wall = IsWall(x, y);
+                to_wall[i] = is_wall ? 0.0f : INFINITY;
+                to_free[i] = is_wall ? INFINITY : 0.0f;
+            }
+        }
+
+        SquaredDistanceTransform(to_wall, pool);
+        SquaredDistanceTransform(to_free, pool);
+
+        pool.ParallelFor(size, 1 << 16, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                distance_[i] = std::sqrt(to_wall[i]) - std::sqrt(to_free[i]);
+            }
+            });
+    }
+
+    void SquaredDistanceTransform(std::vector<float>& field, ThreadPool& pool) {
+        pool.ParallelFor(width_, 64, [&](size_t begin, size_t end) {
+            Transform1D transform(height_);
+            for (size_t x = begin; x < end; ++x) transform.Apply(field.data() + x, width_, height_);
+            });
+        pool.ParallelFor(height_, 16, [&](size_t begin, size_t end) {
+            Transform1D transform(width_);
+            for (size_t y = begin; y < end; ++y) transform.Apply(field.data() + y * width_, 1, width_);
+            });
+    }
+
+    // Lower envelope of parabolas over one row or column, in place with the given stride.
+    struct Transform1D {
+        std::vector<float> values;
+        std::vector<double> boundaries;
+        std::vector<int> parabolas;
+
+        explicit Transform1D(unsigned length) : values(length), boundaries(length + 1), parabolas(length) {}
+
+        void Apply(float* data, size_t stride, unsigned length) {
+            for (unsigned i = 0; i < length; ++i) values[i] = data[i * stride];
+
+            int k = -1;
+            for (int q = 0; q < static_cast<int>(length); ++q) {
+                if (values[q] == INFINITY) continue;
+
+                double s = -INFINITY;
+                while (k >= 0) {
+                    const int p = parabolas[k];
+                    s = ((values[q] + static_cast<double>(q) * q) - (values[p] + static_cast<double>(p) * p)) / (2.0 * (q - p));
+                    if (s > boundaries[k]) break;
+                    --k;
+                }
+                ++k;
+                parabolas[k] = q;
+                boundaries[k] = k == 0 ? -INFINITY : s;
+                boundaries[k + 1] = INFINITY;
+            }
+            if (k < 0) return;
+
+            int j = 0;
+            for (int q = 0; q < static_cast<int>(length); ++q) {
+                while (boundaries[j + 1] < q) ++j;
+                const int p = parabolas[j];
+                const float offset = static_cast<float>(q - p);
+                data[q * stride] = offset * offset + values[p];
+            }
+        }
+    };
+};
@@ -0,0 +1,138 @@
+#include "domain.h"
+#include "settings.h"
+#include "optimizer.h"
+#include "benchmark-functions.h"
+
+#include <chrono>
+#include <iomanip>
+
+// One optimisation run. The time and evaluations to target are those of the iteration that
+// first brought the best fitness down to --target, zero if none did. A stalled run ran out
+// of --patience before its evaluation budget.
+struct OptimizeResult {
+    std::string name;
+    std::string origin;
+    unsigned dimension = 0;
+    float best_fitness = 0.0f;
+    unsigned long long evaluations = 0;
+    double seconds = 0.0;
+    unsigned long long target_evaluations = 0;
+    double target_seconds = 0.0;
+    bool is_stalled = false;
+};
+
+template <size_t Dim>
+OptimizeResult Optimize(const benchmark::Function<Dim>& function, const Settings& settings, ThreadPool& pool) {
+    using Optimizer = SlimeMouldOptimizer<Dim, benchmark::Objective<Dim>>;
+
+    typename Optimizer::Options options;
+    if (settings.num_agents != 0) options.population = settings.num_agents;
+    if (settings.evaluations != 0) options.max_evaluations = settings.evaluations;
+    options.patience = settings.patience;
+    options.seed = settings.seed;
+
+    typename Optimizer::Point lower;
+    typename Optimizer::Point upper;
+    lower.fill(benchmark::LOWER);
+    upper.fill(benchmark::UPPER);
+    Optimizer optimizer(benchmark::Objective<Dim>(function, settings.seed, pool), lower, upper, options, pool);
+
+    OptimizeResult result{ function.name, function.origin, static_cast<unsigned>(Dim) };
+    const auto start = std::chrono::steady_clock::now();
+    bool is_running = true;
+    while (is_running) {
+        is_running = optimizer.Step();
+        if (result.target_evaluations == 0 && optimizer.GetBestFitness() <= settings.target) {
+            result.target_evaluations = optimizer.GetEvaluations();
+            result.target_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.best_fitness = optimizer.GetBestFitness();
+    result.evaluations = optimizer.GetEvaluations();
+    result.is_stalled = optimizer.IsStalled();
+    return result;
+}
+
+template <size_t Dim>
+std::vector<OptimizeResult> OptimizeAll(const Settings& settings, ThreadPool& pool) {
+    std::vector<OptimizeResult> results;
+    for (const auto& function : benchmark::GetFunctions<Dim>()) {
+        if (!settings.filter.empty() && std::string(function.name).find(settings.filter) == std::string::npos) continue;
+        results.push_back(Optimize<Dim>(function, settings, pool));
+    }
+    return results;
+}
+
+void WriteTable(std::ostream& output, const std::vector<OptimizeResult>& results) {
+    output << std::left << std::setw(12) << "function" << std::right << std::setw(5) << "dim"
+        << std::setw(14) << "best" << std::setw(12) << "evals" << std::setw(13) << "evals/sec"
+        << std::setw(13) << "target evals" << std::setw(12) << "target s" << "\n";
+    for (const auto& result : results) {
+        output << std::left << std::setw(12) << result.name << std::right << std::setw(5) << result.dimension
+            << std::setw(14) << std::scientific << std::setprecision(3) << result.best_fitness
+            << std::setw(12) << result.evaluations
+            << std::setw(13) << std::setprecision(2) << (result.seconds > 0 ? result.evaluations / result.seconds : 0.0);
+        if (result.target_evaluations != 0) {
+            output << std::setw(13) << result.target_evaluations << std::setw(12) << std::fixed << std::setprecision(4) << result.target_seconds;
+        }
+        else {
+            output << std::setw(13) << "-" << std::setw(12) << "-";
+        }
+        output << std::defaultfloat << std::setprecision(6) << "\n";
+    }
+}
+
+void WriteJson(std::ostream& output, const std::vector<OptimizeResult>& results, const Settings& settings, unsigned threads) {
+    output << "{\n"
+        << "  \"version\": 1,\n"
+        << "  \"seed\": " << settings.seed << ",\n"
+        << "  \"threads\": " << threads << ",\n"
+        << "  \"target\": " << settings.target << ",\n"
+        << "  \"patience\": " << settings.patience << ",\n"
+        << "  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const OptimizeResult& result = results[i];
+        output << (i == 0 ? "\n" : ",\n")
+            << "    { \"name\": \"" << result.name << "\""
+            << ", \"origin\": \"" << result.origin << "\""
+            << ", \"dimension\": " << result.dimension
+            << ", \"best_fitness\": " << result.best_fitness
+            << ", \"evaluations\": " << result.evaluations
+            << ", \"seconds\": " << result.seconds
+            << ", \"evaluations_per_second\": " << (result.seconds > 0 ? result.evaluations / result.seconds : 0.0)
+            << ", \"target_evaluations\": " << result.target_evaluations
+            << ", \"target_seconds\": " << result.target_seconds
+            << ", \"stalled\": " << (result.is_stalled ? "true" : "false") << " }";
+    }
+    output << "\n  ]\n}\n";
+}
+
+int main(int argc, char** argv) {
+    Settings settings;
+    if (!ParseSettings(argc, argv, settings)) return EXIT_FAILURE;
+    if (settings.seed == 0) settings.seed = 1;
+
+    ThreadPool pool(settings.threads);
+    std::vector<OptimizeResult> results;
+    switch (settings.dimension) {
+    case 2: results = OptimizeAll<2>(settings, pool); break;
+    case 10: results = OptimizeAll<10>(settings, pool); break;
+    case 30: results = OptimizeAll<30>(settings, pool); break;
+    case 50: results = OptimizeAll<50>(settings, pool); break;
+    default:
+        std::cerr << "Unsupported dimension " << settings.dimension << ", use 2, 10, 30 or 50\n";
+        return EXIT_FAILURE;
+    }
+
+    WriteTable(std::cout, results);
+    if (!settings.output.empty()) {
+        std::ofstream output(settings.output);
+        if (!output) {
+            std::cerr << "Error writing '" << settings.output << "'\n";
+            return EXIT_FAILURE;
+        }
+        WriteJson(output, results, settings, pool.GetThreadCount());
+    }
+    return 0;
+}
@@ -0,0 +1,158 @@
+#pragma once
+#include "domain.h"
+#include "framework.h"
+#include "parallel.h"
+
+#include <array>
+
+namespace optimizer {
+    const size_t POPULATION = 30;
+    const float RESTART_PROBABILITY = 0.03f;
+    const size_t AGENTS_PER_TASK = 256;
+    // With a patience, an iteration counts as an improvement when it lowers the best fitness
+    // by more than this share of it.
+    const float MIN_IMPROVEMENT = 1e-6f;
+}
+
+// The slime mould algorithm of Li et al. (2020) as a general minimiser over a box in Dim
+// dimensions, the same update the simulation runs on its 2D agents. The objective is called
+// once per iteration on the whole population:
+//
+//     void operator()(const std::array<float, Dim>* points, size_t count, float* fitness) const
+//
+// so it can vectorise or thread the batch however suits it. Every random draw is keyed by
+// (seed, iteration, agent, dimension) and the new positions go to a back buffer, so a run is
+// the same for any thread count.
+template <size_t Dim, typename Objective>
+class SlimeMouldOptimizer {
+public:
+    using Point = std::array<float, Dim>;
+
+    struct Options {
+        size_t population = optimizer::POPULATION;
+        unsigned long long max_evaluations = 10'000ull * Dim;
+        float restart_probability = optimizer::RESTART_PROBABILITY;
+        // Iterations without improvement before Step gives up early; 0 spends the whole budget.
+        unsigned long long patience = 0;
+        uint64_t seed = 1;
+    };
+
+    SlimeMouldOptimizer(Objective objective, const Point& lower, const Point& upper, const Options& options, ThreadPool& pool)
+        : objective_(std::move(objective)), lower_(lower), upper_(upper), options_(options), pool_(pool),
+        max_iteration_(std::max<unsigned long long>(options.max_evaluations / std::max<size_t>(options.population, 1), 1)),
+        positions_(std::max<size_t>(options.population, 2)), next_positions_(positions_.size()),
+        fitness_(positions_.size()), rank_(positions_.size()), order_(positions_.size()) {
+        const RandomStream random(options_.seed, 0);
+        for (size_t i = 0; i < positions_.size(); ++i) {
+            for (size_t j = 0; j < Dim; ++j) {
+                positions_[i][j] = lower_[j] + random.Uniform(i * Dim + j, draw::OPT_POSITION) * (upper_[j] - lower_[j]);
+            }
+        }
+        best_position_ = positions_.front();
+    }
+
+    // Evaluates the population and moves it once. False when the evaluation budget is spent
+    // or the best fitness has stalled for the patience.
+    bool Step() {
+        if (iteration_ >= max_iteration_ || IsStalled()) return false;
+        ++iteration_;
+
+        objective_(positions_.data(), positions_.size(), fitness_.data());
+        evaluations_ += positions_.size();
+        const float previous_best = best_fitness_;
+        Rank();
+        if (previous_best - best_fitness_ > optimizer::MIN_IMPROVEMENT * std::abs(previous_best)) stalled_iterations_ = 0;
+        else ++stalled_iterations_;
+
+        const float progress = iteration_ / static_cast<float>(max_iteration_);
+        const float a = CalculateA(progress);
+        const float b = CalculateVC(progress);
+        const RandomStream random(options_.seed, iteration_);
+        pool_.ParallelFor(positions_.size(), optimizer::AGENTS_PER_TASK, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) Update(i, a, b, random);
+            });
+        positions_.swap(next_positions_);
+        return iteration_ < max_iteration_ && !IsStalled();
+    }
+
+    bool IsStalled() const { return options_.patience != 0 && stalled_iterations_ >= options_.patience; }
+
+    float GetBestFitness() const { return best_fitness_; }
+    const Point& GetBestPosition() const { return best_position_; }
+    unsigned long long GetEvaluations() const { return evaluations_; }
+    unsigned long long GetIteration() const { return iteration_; }
+    unsigned long long GetMaxIteration() const { return max_iteration_; }
+    const std::vector<Point>& GetPositions() const { return positions_; }
+
+private:
+    Objective objective_;
+    Point lower_;
+    Point upper_;
+    Options options_;
+    ThreadPool& pool_;
+    unsigned long long max_iteration_;
+    unsigned long long iteration_ = 0;
+    unsigned long long evaluations_ = 0;
+    unsigned long long stalled_iterations_ = 0;
+
+    std::vector<Point> positions_;
+    std::vector<Point> next_positions_;
+    std::vector<float> fitness_;
+    std::vector<uint32_t> rank_;
+    std::vector<uint32_t> order_;
+    FitnessRange range_ = {};
+    Point best_position_;
+    float best_fitness_ = std::numeric_limits<float>::max();
+
+    // Sorts by fitness, ties by index, and takes this iteration's range and the best so far.
+    void Rank() {
+        std::iota(order_.begin(), order_.end(), 0u);
+        std::sort(order_.begin(), order_.end(), [&](uint32_t a, uint32_t b) {
+            return fitness_[a] < fitness_[b] || (fitness_[a] == fitness_[b] && a < b);
+            });
+        for (size_t r = 0; r < order_.size(); ++r) rank_[order_[r]] = static_cast<uint32_t>(r);
+
+        range_ = { fitness_[order_.front()], fitness_[order_.back()] };
+        if (range_.best < best_fitness_) {
+            best_fitness_ = range_.best;
+            best_position_ = positions_[order_.front()];
+        }
+    }
+
+    // The better half of the population gets weights above one, the worse half below, each
+    // by the log of the agent's normalised distance from this iteration's best.
+    float CalculateWeight(size_t i, float r) const {
+        const float spread = range_.best - range_.worst - std::numeric_limits<float>::epsilon();
+        const float term = r * std::log10((range_.best - fitness_[i]) / spread + 1.0f);
+        return rank_[i] < positions_.size() / 2 ? 1.0f + term : 1.0f - term;
+    }
+
+    void Update(size_t i, float a, float b, const RandomStream& random) {
+        Point& next = next_positions_[i];
+        if (random.Uniform(i, draw::OPT_RESTART) < options_.restart_probability) {
+            for (size_t j = 0; j < Dim; ++j) {
+                next[j] = lower_[j] + random.Uniform(i * Dim + j, draw::OPT_POSITION) * (upper_[j] - lower_[j]);
+            }
+            return;
+        }
+
+        const float p = std::tanh(std::abs(fitness_[i] - best_fitness_));
+        const Point& position = positions_[i];
+        for (size_t j = 0; j < Dim; ++j) {
+            const uint64_t index = i * Dim + j;
+            float value;
+            if (random.Uniform(index, draw::SMA_CHOICE) < p) {
+                const Point& partner_a = positions_[random.Next(index, draw::PARTNER_A) % positions_.size()];
+                const Point& partner_b = positions_[random.Next(index, draw::PARTNER_B) % positions_.size()];
+                const float weight = CalculateWeight(i, random.Uniform(index, draw::FOOD_WEIGHT));
+                const float vb = (random.Uniform(index, draw::VB) * 2.0f - 1.0f) * a;
+                value = best_position_[j] + vb * (weight * partner_a[j] - partner_b[j]);
+            }
+            else {
+                const float vc = (random.Uniform(index, draw::OPT_VC) * 2.0f - 1.0f) * b;
+                value = vc * position[j];
+            }
+            next[j] = std::clamp(value, lower_[j], upper_[j]);
+        }
+    }
+};
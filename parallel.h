@@ -0,0 +1,106 @@
+#pragma once
+#include "domain.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Fixed set of worker threads that execute numbered tasks. The calling thread
+// takes part in every Run, so a pool of one thread runs everything inline.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned thread_count = 0) {
+        if (thread_count == 0) thread_count = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned i = 1; i < thread_count; ++i) {
+            workers_.emplace_back([this] { WorkerLoop(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto& worker : workers_) worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned GetThreadCount() const { return static_cast<unsigned>(workers_.size()) + 1; }
+
+    // Calls task(i) for every i in [0, task_count) and returns once all calls are done.
+    template <typename Task>
+    void Run(size_t task_count, const Task& task) {
+        if (task_count == 0) return;
+        if (workers_.empty() || task_count == 1) {
+            for (size_t i = 0; i < task_count; ++i) task(i);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            task_ = &task;
+            invoke_ = [](const void* task, size_t i) { (*static_cast<const Task*>(task))(i); };
+            task_count_ = task_count;
+            next_task_.store(0, std::memory_order_relaxed);
+            busy_workers_ = workers_.size();
+            ++generation_;
+        }
+        wake_.notify_all();
+
+        Work();
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this] { return busy_workers_ == 0; });
+    }
+
+    // Splits [0, count) into ranges of at most `grain` items and calls body(begin, end) for each.
+    template <typename Body>
+    void ParallelFor(size_t count, size_t grain, const Body& body) {
+        grain = std::max<size_t>(grain, 1);
+        Run((count + grain - 1) / grain, [&](size_t task) {
+            const size_t begin = task * grain;
+            body(begin, std::min(count, begin + grain));
+        });
+    }
+
+private:
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    bool stop_ = false;
+    size_t generation_ = 0;
+    size_t busy_workers_ = 0;
+
+    const void* task_ = nullptr;
+    void (*invoke_)(const void*, size_t) = nullptr;
+    size_t task_count_ = 0;
+    std::atomic<size_t> next_task_{ 0 };
+
+    void Work() {
+        for (size_t i = next_task_.fetch_add(1); i < task_count_; i = next_task_.fetch_add(1)) {
+            invoke_(task_, i);
+        }
+    }
+
+    void WorkerLoop() {
+        size_t seen_generation = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [&] { return stop_ || generation_ != seen_generation; });
+                if (stop_) return;
+                seen_generation = generation_;
+            }
+
+            Work();
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--busy_workers_ == 0) done_.notify_one();
+        }
+    }
+};
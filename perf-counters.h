@@ -0,0 +1,188 @@
+#pragma once
+#include "domain.h"
+#include "trace.h"
+
+#include <array>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Hardware counters per simulation phase through perf_event_open, without perf or any
+// other service. Each thread opens its own counters the first time it enters a phase
+// scope and adds the difference between entry and exit to that phase. Counters the
+// kernel or the machine refuses (no PMU in a VM, perf_event_paranoid above 2) are
+// reported as unavailable. Uses the same SLIME_TRACING switch as the trace scopes.
+namespace perf {
+    bool ENABLED = false;
+
+    enum Phase { FOOD_EVAL, MOVE, SENSE, DEPOSIT, DIFFUSE, PHASE_COUNT };
+    const char* const PHASE_NAMES[PHASE_COUNT] = { "food_eval", "move", "sense", "deposit", "decay+diffuse" };
+
+    enum Counter { TASK_CLOCK, CYCLES, INSTRUCTIONS, LLC_MISSES, DTLB_MISSES, BRANCH_MISSES, COUNTER_COUNT };
+    const char* const COUNTER_NAMES[COUNTER_COUNT] = { "task-ns", "cycles", "instr", "LLC-miss", "dTLB-miss", "br-miss" };
+
+    using Values = std::array<double, COUNTER_COUNT>;
+
+    class ThreadCounters {
+    public:
+        ThreadCounters() {
+            fds_.fill(-1);
+#if defined(__linux__)
+            const auto cache_event = [](uint64_t cache, uint64_t op, uint64_t result) { return cache | (op << 8) | (result << 16); };
+            Open(TASK_CLOCK, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK);
+            Open(CYCLES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+            Open(INSTRUCTIONS, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+            Open(LLC_MISSES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+            Open(DTLB_MISSES, PERF_TYPE_HW_CACHE,
+                cache_event(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS));
+            Open(BRANCH_MISSES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+#endif
+        }
+
+        ~ThreadCounters() {
+#if defined(__linux__)
+            for (int fd : fds_) {
+                if (fd >= 0) close(fd);
+            }
+#endif
+        }
+
+        ThreadCounters(const ThreadCounters&) = delete;
+        ThreadCounters& operator=(const ThreadCounters&) = delete;
+
+        bool IsAvailable(Counter counter) const { return fds_[counter] >= 0; }
+
+        // Current counts, scaled up when the kernel had to multiplex the counters.
+        void Read(Values& values) const {
+            values.fill(0.0);
+#if defined(__linux__)
+            for (size_t c = 0; c < COUNTER_COUNT; ++c) {
+                uint64_t data[3] = {};
+                if (fds_[c] < 0 || read(fds_[c], data, sizeof(data)) != sizeof(data)) continue;
+                values[c] = data[2] != 0 ? static_cast<double>(data[0]) * data[1] / data[2] : 0.0;
+            }
+#endif
+        }
+
+        void Add(Phase phase, const Values& start, const Values& end) {
+            for (size_t c = 0; c < COUNTER_COUNT; ++c) totals_[phase][c] += end[c] - start[c];
+        }
+
+        const Values& GetTotals(Phase phase) const { return totals_[phase]; }
+
+        void Reset() {
+            for (auto& totals : totals_) totals.fill(0.0);
+        }
+
+    private:
+        std::array<int, COUNTER_COUNT> fds_;
+        std::array<Values, PHASE_COUNT> totals_{};
+
+#if defined(__linux__)
+        void Open(Counter counter, uint32_t type, uint64_t config) {
+            perf_event_attr attr{};
+            attr.size = sizeof(attr);
+            attr.type = type;
+            attr.config = config;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            fds_[counter] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+#endif
+    };
+
+    std::mutex REGISTRY_MUTEX;
+    std::vector<std::unique_ptr<ThreadCounters>> COUNTERS;
+
+    ThreadCounters& GetThreadCounters() {
+        thread_local ThreadCounters* counters = nullptr;
+        if (counters == nullptr) {
+            std::lock_guard<std::mutex> lock(REGISTRY_MUTEX);
+            COUNTERS.push_back(std::make_unique<ThreadCounters>());
+            counters = COUNTERS.back().get();
+        }
+        return *counters;
+    }
+
+    class Scope {
+    public:
+        explicit Scope(Phase phase) : phase_(phase), counters_(ENABLED ? &GetThreadCounters() : nullptr) {
+            if (counters_) counters_->Read(start_);
+        }
+
+        ~Scope() {
+            if (!counters_) return;
+            Values end;
+            counters_->Read(end);
+            counters_->Add(phase_, start_, end);
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        Phase phase_;
+        ThreadCounters* counters_;
+        Values start_;
+    };
+
+    // Call these between steps, when no phase scope is open.
+    void Reset() {
+        std::lock_guard<std::mutex> lock(REGISTRY_MUTEX);
+        for (auto& counters : COUNTERS) counters->Reset();
+    }
+
+    // Totals over all threads per agent-step (agent phases) or pixel-step (decay+diffuse).
+    void WriteReport(std::ostream& output, unsigned long long steps, size_t agents, size_t pixels) {
+        std::lock_guard<std::mutex> lock(REGISTRY_MUTEX);
+        if (COUNTERS.empty() || steps == 0) return;
+
+        std::array<bool, COUNTER_COUNT> is_available{};
+        for (size_t c = 0; c < COUNTER_COUNT; ++c) is_available[c] = COUNTERS.front()->IsAvailable(static_cast<Counter>(c));
+
+        output << std::left << std::setw(15) << "phase" << std::setw(7) << "per";
+        for (const char* name : COUNTER_NAMES) output << std::right << std::setw(11) << name;
+        output << std::right << std::setw(7) << "IPC" << "\n";
+
+        for (size_t p = 0; p < PHASE_COUNT; ++p) {
+            Values totals{};
+            for (const auto& counters : COUNTERS) {
+                const Values& phase_totals = counters->GetTotals(static_cast<Phase>(p));
+                for (size_t c = 0; c < COUNTER_COUNT; ++c) totals[c] += phase_totals[c];
+            }
+
+            const bool is_pixel_phase = p == DIFFUSE;
+            const double units = static_cast<double>(steps) * (is_pixel_phase ? pixels : agents);
+            output << std::left << std::setw(15) << PHASE_NAMES[p] << std::setw(7) << (is_pixel_phase ? "pixel" : "agent") << std::right;
+            for (size_t c = 0; c < COUNTER_COUNT; ++c) {
+                if (is_available[c]) output << std::setw(11) << std::fixed << std::setprecision(3) << totals[c] / units;
+                else output << std::setw(11) << "n/a";
+            }
+            if (is_available[CYCLES] && is_available[INSTRUCTIONS] && totals[CYCLES] > 0) {
+                output << std::setw(7) << std::setprecision(2) << totals[INSTRUCTIONS] / totals[CYCLES];
+            }
+            else {
+                output << std::setw(7) << "n/a";
+            }
+            output << "\n";
+        }
+        output << std::defaultfloat << std::setprecision(6);
+
+        if (!is_available[CYCLES]) {
+            output << "Hardware counters are unavailable (no PMU, or kernel.perf_event_paranoid is above 2).\n";
+        }
+    }
+}
+
+#if SLIME_TRACING
+#define SLIME_PERF_SCOPE(phase) const perf::Scope SLIME_TRACE_CONCAT(perf_scope_, __LINE__)(phase)
+#else
+#define SLIME_PERF_SCOPE(phase) do {} while (false)
+#endif
@@ -0,0 +1,238 @@
+#pragma once
+#include "domain.h"
+#include "engine.h"
+#include "snapshot.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Single producer, single consumer hand-off of whole frames. The producer fills the back
+// buffer and publishes it; the consumer takes the latest published one. Neither side
+// ever waits, and frames the consumer did not get to are overwritten.
+template <typename T>
+class TripleBuffer {
+public:
+    T& GetWriteBuffer() { return buffers_[write_]; }
+    const T& GetReadBuffer() const { return buffers_[read_]; }
+
+    void Publish() {
+        write_ = state_.exchange(write_ | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // True if the consumer has not taken the last published buffer yet.
+    bool HasFresh() const { return state_.load(std::memory_order_acquire) & FRESH; }
+
+    // Makes the latest published buffer the read buffer; false if nothing new was published.
+    bool Acquire() {
+        if (!HasFresh()) return false;
+        read_ = state_.exchange(read_, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+
+private:
+    static constexpr unsigned INDEX_MASK = 3;
+    static constexpr unsigned FRESH = 4;
+
+    std::array<T, 3> buffers_;
+    unsigned write_ = 0;
+    unsigned read_ = 1;
+    std::atomic<unsigned> state_{ 2 };
+};
+
+// Everything the viewer draws, copied out at the end of a step.
+struct RenderFrame {
+    std::vector<uint8_t> trail_rgba;
+    std::vector<Vector2f> food;
+    Vector2f best_position;
+    unsigned long long step = 0;
+    unsigned steps_per_update = 1;
+    bool is_fast_forward = false;
+};
+
+struct SimulationCommand {
+    enum Type { ADD_FOOD, REMOVE_FOOD, TOGGLE_PAUSE, SNAPSHOT, TOGGLE_FAST_FORWARD, RUN_UNTIL_CONVERGED };
+
+    Type type;
+    Vector2f position{};
+    float radius = 0.0f;
+};
+
+// Owns the engine's side of the viewer. Input arrives as queued commands and is applied
+// between two updates; finished frames leave through a triple buffer. Start() moves the
+// loop to its own thread, which updates as fast as it can; without it the caller drives
+// one update per Tick().
+//
+// An update is one step, or in fast-forward K steps with nothing exported in between.
+// K adapts so that an update takes about one display frame, which keeps the window (or,
+// pipelined, the command latency) responsive. Running until converged is fast-forward
+// that pauses by itself once Engine::IsConverged.
+class SimulationRunner {
+public:
+    SimulationRunner(Engine& engine, const std::string& snapshot_path, bool is_paused, bool until_converged)
+        : engine_(engine), snapshot_path_(snapshot_path), is_paused_(is_paused) {
+        if (until_converged) StartUntilConverged();
+        ExportFrame();
+    }
+
+    ~SimulationRunner() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_one();
+        if (thread_.joinable()) thread_.join();
+    }
+
+    SimulationRunner(const SimulationRunner&) = delete;
+    SimulationRunner& operator=(const SimulationRunner&) = delete;
+
+    void Start() {
+        thread_ = std::thread([this] { SimulationLoop(); });
+    }
+
+    void Post(const SimulationCommand& command) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            commands_.push_back(command);
+        }
+        wake_.notify_one();
+    }
+
+    void Tick() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        pending_.swap(commands_);
+        lock.unlock();
+        Update();
+    }
+
+    // The newest finished frame becomes GetFrame(); false if there is none since the last call.
+    bool AcquireFrame() { return frames_.Acquire(); }
+    const RenderFrame& GetFrame() const { return frames_.GetReadBuffer(); }
+
+private:
+    Engine& engine_;
+    std::string snapshot_path_;
+    SnapshotWriter snapshot_writer_;
+    TripleBuffer<RenderFrame> frames_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::vector<SimulationCommand> commands_;
+    bool stop_ = false;
+    std::thread thread_;
+
+    // Simulation side only.
+    std::vector<SimulationCommand> pending_;
+    bool is_paused_;
+    bool is_frame_stale_ = false;
+    bool is_fast_forward_ = false;
+    bool is_until_converged_ = false;
+    unsigned steps_per_update_ = 1;
+
+    static constexpr unsigned MAX_STEPS_PER_UPDATE = 4096;
+
+    void SimulationLoop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            wake_.wait(lock, [this] { return stop_ || !commands_.empty() || !is_paused_ || is_frame_stale_; });
+            if (stop_) return;
+            pending_.swap(commands_);
+            lock.unlock();
+            Update();
+            lock.lock();
+        }
+    }
+
+    void Update() {
+        bool is_edited = false;
+        for (const auto& command : pending_) {
+            switch (command.type) {
+            case SimulationCommand::ADD_FOOD:
+                engine_.AddFood(command.position);
+                is_edited = true;
+                break;
+            case SimulationCommand::REMOVE_FOOD:
+                is_edited |= engine_.RemoveFood(command.position, command.radius);
+                break;
+            case SimulationCommand::TOGGLE_PAUSE:
+                is_paused_ = !is_paused_;
+                break;
+            case SimulationCommand::SNAPSHOT: {
+                auto snapshot = std::make_unique<Snapshot>();
+                engine_.CaptureSnapshot(*snapshot);
+                snapshot_writer_.Submit(std::move(snapshot), snapshot_path_);
+                break;
+            }
+            case SimulationCommand::TOGGLE_FAST_FORWARD:
+                is_fast_forward_ = !is_fast_forward_;
+                is_until_converged_ = false;
+                engine_.TrackConvergence(false);
+                is_edited = true;
+                break;
+            case SimulationCommand::RUN_UNTIL_CONVERGED:
+                StartUntilConverged();
+                is_paused_ = false;
+                break;
+            }
+        }
+        pending_.clear();
+
+        if (!is_paused_) {
+            if (is_fast_forward_) FastForward();
+            else engine_.Step();
+        }
+
+        // While the viewer has not taken the last frame, exporting another one is wasted
+        // work; the state is exported once it has, or once the simulation pauses.
+        if (is_edited || (!is_paused_ && !frames_.HasFresh()) || (is_paused_ && is_frame_stale_)) {
+            ExportFrame();
+        }
+        else if (!is_paused_) {
+            is_frame_stale_ = true;
+        }
+    }
+
+    void StartUntilConverged() {
+        is_fast_forward_ = true;
+        is_until_converged_ = true;
+        engine_.TrackConvergence(true);
+    }
+
+    void FastForward() {
+        const auto start = std::chrono::steady_clock::now();
+        for (unsigned i = 0; i < steps_per_update_ && !(is_until_converged_ && engine_.IsConverged()); ++i) engine_.Step();
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // Aim for one display frame per update, at most doubling or halving K at a time.
+        const double target = 1.0 / constant::FPS;
+        const double scale = elapsed > 0.0 ? std::clamp(target / elapsed, 0.5, 2.0) : 2.0;
+        steps_per_update_ = std::clamp(static_cast<unsigned>(steps_per_update_ * scale + 0.5), 1u, MAX_STEPS_PER_UPDATE);
+
+        if (is_until_converged_ && engine_.IsConverged()) {
+            std::cout << "Converged at step " << engine_.GetStepCount()
+                << ", trail change " << engine_.GetConvergence().trail_change << "\n";
+            is_paused_ = true;
+            is_fast_forward_ = false;
+            is_until_converged_ = false;
+            engine_.TrackConvergence(false);
+            is_frame_stale_ = true;
+        }
+    }
+
+    void ExportFrame() {
+        SLIME_TRACE_SCOPE("export_frame");
+        RenderFrame& frame = frames_.GetWriteBuffer();
+        engine_.GetTrailMap().ExportRgba(frame.trail_rgba);
+        frame.food = engine_.GetFood();
+        frame.best_position = engine_.GetContext().best_position;
+        frame.step = engine_.GetStepCount();
+        frame.steps_per_update = is_fast_forward_ ? steps_per_update_ : 1;
+        frame.is_fast_forward = is_fast_forward_;
+        frames_.Publish();
+        is_frame_stale_ = false;
+    }
+};
@@ -12,4 +12,83 @@ uint32_t Hash(uint32_t state) {
 
 float ScaleToRange01(uint32_t value) {
     return static_cast<float>(value) / 4294967295.0f;
-}
\ No newline at end of file
+}
+
+uint64_t SplitMix64(uint64_t state) {
+    state += 0x9E3779B97F4A7C15ull;
+    state = (state ^ (state >> 30)) * 0xBF58476D1CE4E5B9ull;
+    state = (state ^ (state >> 27)) * 0x94D049BB133111EBull;
+    return state ^ (state >> 31);
+}
+
+// Widynski's "Squares" counter-based generator: four rounds of middle-square
+// mixing turn (counter, key) into 32 random bits without any hidden state.
+uint32_t Squares32(uint64_t counter, uint64_t key) {
+    uint64_t x = counter * key;
+    const uint64_t y = x;
+    const uint64_t z = y + key;
+    x = x * x + y; x = (x >> 32) | (x << 32);
+    x = x * x + z; x = (x >> 32) | (x << 32);
+    x = x * x + y; x = (x >> 32) | (x << 32);
+    return static_cast<uint32_t>((x * x + z) >> 32);
+}
+
+// Every random decision has its own draw id, so adding a draw never shifts the others.
+namespace draw {
+    enum Id : uint32_t {
+        INIT_POSITION_X,
+        INIT_POSITION_Y,
+        INIT_HEADING,
+        INIT_RADIUS,
+        INIT_ANGLE,
+        INIT_SPAWN,
+        FOOD_X,
+        FOOD_Y,
+        SMA_CHOICE,
+        PARTNER_A,
+        PARTNER_B,
+        VB,
+        MAZE_TURN,
+        BORDER_TURN,
+        SENSOR_CHOICE,
+        FOOD_WEIGHT,
+        OPT_POSITION,
+        OPT_RESTART,
+        OPT_VC,
+        OPT_SHIFT,
+        PARTNER_SAMPLE,
+        RETIRE
+    };
+
+    const unsigned BITS = 24;
+}
+
+// Random numbers for one (seed, step). A value depends only on (seed, step, index, draw id),
+// so any thread can draw for any agent and a run does not depend on the thread count.
+class RandomStream {
+public:
+    RandomStream(uint64_t seed, uint64_t step)
+        : key_(SplitMix64(SplitMix64(seed) ^ step) | 1ull) {
+    }
+
+    uint32_t Next(uint64_t index, uint32_t draw_id) const {
+        return Squares32((index << draw::BITS) | draw_id, key_);
+    }
+
+    // Uniform in [0, 1).
+    float Uniform(uint64_t index, uint32_t draw_id) const {
+        return (Next(index, draw_id) >> 8) * (1.0f / 16777216.0f);
+    }
+
+    // values[i] = Uniform(indices[i], draw_id) for the whole vector.
+    void FillUniform(const uint32_t* indices, uint32_t draw_id, std::vector<float>& values) const {
+        const size_t count = values.size();
+        float* out = values.data();
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = (Squares32((static_cast<uint64_t>(indices[i]) << draw::BITS) | draw_id, key_) >> 8) * (1.0f / 16777216.0f);
+        }
+    }
+
+private:
+    uint64_t key_;
+};
@@ -0,0 +1,318 @@
+#pragma once
+#include "domain.h"
+#include "framework.h"
+
+#include <charconv>
+
+struct Settings {
+    frame::Size frame = frame::CURRENT;
+    mode::Type mode = mode::CURRENT;
+    unsigned width = 0;
+    unsigned height = 0;
+    unsigned num_agents = 0;
+    bool is_maze = mode::IS_MAZE;
+    std::string maze_file;
+    bool is_polling = mode::IS_POLLING;
+    bool is_run = mode::IS_RUN;
+    unsigned seed = 0;
+    unsigned steps = 1000;
+    unsigned threads = 0;
+    unsigned reorder_every = 0;
+    bool scaling = false;
+    unsigned food_count = 0;
+    diffusion::Operator blur = diffusion::CURRENT;
+    float blur_strength = simulation::BLUR_STRENGTH;
+    float decay_rate = simulation::DECAY_RATE;
+    float speed = agent::SPEED;
+    float rotation_angle = agent::ROTATION_ANGLE;
+    float angle_responsiveness = simulation::ANGLE_RESPONSIVNESS;
+    float sensor_distance = sensor::DISTANCE;
+    float sensor_angle = sensor::ANGLE;
+    std::vector<Vector2f> food;
+    std::string font_path;
+    std::string filter;
+    float min_time = 1.0f;
+    std::string output;
+    std::string trace_path;
+    bool perf = false;
+    std::string snapshot_path;
+    std::string resume_path;
+    std::string trajectory_path;
+    unsigned trajectory_every = 10;
+    bool is_pipelined = true;
+    bool until_converged = false;
+    bool adaptive_population = false;
+    unsigned dimension = 10;
+    unsigned evaluations = 0;
+    float target = 1e-8f;
+    unsigned patience = 0;
+    bool is_sparse_trail = false;
+    bool check_allocations = false;
+    unsigned ranks = 1;
+    std::vector<std::string> sweep;
+    unsigned repeats = 1;
+};
+
+void PrintUsage(const char* program) {
+    std::cout << "Usage: " << program << " [--key=value | --key value]...\n"
+        << "  --config PATH        read key = value lines from PATH\n"
+        << "  --frame NAME         mini | small | medium | big\n"
+        << "  --width N            override the frame width\n"
+        << "  --height N           override the frame height\n"
+        << "  --agents N           override the number of agents\n"
+        << "  --mode NAME          noise | circle | center | two-points | three-points\n"
+        << "  --maze BOOL          enable maze walls\n"
+        << "  --maze-file PATH     walls from a PGM image (dark is wall) or a text grid ('1' or '#' is wall); implies --maze\n"
+        << "  --polling BOOL       reflect from borders instead of wrapping\n"
+        << "  --run BOOL           let agents move\n"
+        << "  --seed N             random seed, 0 picks one from the clock\n"
+        << "  --steps N            number of steps for headless runs\n"
+        << "  --until-converged BOOL  stop once the trail network settles (headless: at most --steps)\n"
+        << "  --adaptive-population BOOL  retire agents where the trail network has settled\n"
+        << "  --threads N          worker threads, 0 uses every core\n"
+        << "  --scaling BOOL       headless: repeat the run from 1 thread up to --threads; distributed: from 1 rank up to --ranks\n"
+        << "  --reorder-every K    sort agents by Z-order of position every K steps, 0 disables\n"
+        << "  --food X,Y           add a food source, may be repeated\n"
+        << "  --food-count N       scatter N food sources at random\n"
+        << "  --blur NAME          gaussian | box (repeated box filter, cost independent of strength)\n"
+        << "  --blur-strength F    spacing of the blur taps in pixels\n"
+        << "  --decay-rate F       factor the trail is multiplied by every step\n"
+        << "  --speed F            agent speed in pixels per step\n"
+        << "  --rotation-angle F   degrees an agent turns towards the stronger sensor\n"
+        << "  --angle-responsiveness F  extra turn of low-weight agents near food\n"
+        << "  --sensor-distance F  pixels from an agent to its sensors\n"
+        << "  --sensor-angle F     degrees between the forward sensor and the side ones\n"
+        << "  --sparse-trail BOOL  keep the trail map in 64x64 tiles allocated where it is non-zero, for large worlds\n"
+        << "  --ranks N            distributed: processes the world is split between, in strips of trail tiles\n"
+        << "  --font PATH          font for the viewer overlay\n"
+        << "  --pipeline BOOL      viewer: step on a separate thread, not throttled by the display\n"
+        << "  --trace PATH         record per-phase timings and write them as Chrome trace JSON on exit\n"
+        << "  --check-allocations BOOL  fail if a step (viewer: a frame) allocates once warmed up\n"
+        << "  --perf BOOL          headless: hardware counters per phase, per agent and per pixel (Linux)\n"
+        << "  --snapshot PATH      where S in the viewer saves the state; headless: save the final state\n"
+        << "  --resume PATH        continue from a snapshot; its frame, agents, seed, food and maze win\n"
+        << "  --trajectory PATH    stream agent positions and weights to PATH while running\n"
+        << "  --trajectory-every N record every Nth step to the trajectory\n"
+        << "  --filter TEXT        bench: only run benchmarks whose label contains TEXT\n"
+        << "  --min-time SECONDS   bench: minimum measuring time per benchmark\n"
+        << "  --output PATH        bench: write the JSON report to PATH instead of stdout\n"
+        << "  --dimension N        optimize: 2 | 10 | 30 | 50\n"
+        << "  --evaluations N      optimize: objective evaluations per function, 0 means 10000 * dimension\n"
+        << "  --target F           optimize: fitness counted as reaching the optimum\n"
+        << "  --patience N         optimize: stop after N iterations without a better fitness, 0 spends the whole budget\n"
+        << "  --sweep KEY=V1,V2    sweep: one axis of the parameter grid, may be repeated\n"
+        << "  --repeats N          sweep: runs per grid point, with consecutive seeds\n";
+}
+
+bool ParseBool(const std::string& value, bool& result) {
+    if (value == "1" || value == "true" || value == "on" || value == "yes") result = true;
+    else if (value == "0" || value == "false" || value == "off" || value == "no") result = false;
+    else return false;
+    return true;
+}
+
+bool ParseUnsigned(const std::string& value, unsigned& result) {
+    if (value.empty() || value.find_first_not_of("0123456789'") != std::string::npos) return false;
+
+    std::string digits;
+    std::copy_if(value.begin(), value.end(), std::back_inserter(digits), [](char c) { return c != '\''; });
+    // Anything past the range of unsigned is a typo rather than something to wrap around.
+    unsigned parsed = 0;
+    const auto [end, error] = std::from_chars(digits.data(), digits.data() + digits.size(), parsed);
+    if (error != std::errc() || end != digits.data() + digits.size()) return false;
+    result = parsed;
+    return true;
+}
+
+bool ParseFloat(const std::string& value, float& result) {
+    char* end = nullptr;
+    result = std::strtof(value.c_str(), &end);
+    return !value.empty() && *end == '\0';
+}
+
+bool ParseBlur(const std::string& value, diffusion::Operator& result) {
+    if (value == "gaussian") result = diffusion::GAUSSIAN;
+    else if (value == "box") result = diffusion::BOX;
+    else return false;
+    return true;
+}
+
+bool ParseFrame(const std::string& value, frame::Size& result) {
+    if (value == "mini") result = frame::MINI;
+    else if (value == "small") result = frame::SMALL;
+    else if (value == "medium") result = frame::MEDIUM;
+    else if (value == "big") result = frame::BIG;
+    else return false;
+    return true;
+}
+
+bool ParseMode(const std::string& value, mode::Type& result) {
+    if (value == "noise") result = mode::NOISE;
+    else if (value == "circle") result = mode::CIRCLE;
+    else if (value == "center") result = mode::CENTER;
+    else if (value == "two-points") result = mode::TWO_POINTS;
+    else if (value == "three-points") result = mode::THREE_POINTS;
+    else return false;
+    return true;
+}
+
+bool ParsePoint(const std::string& value, Vector2f& result) {
+    const size_t comma = value.find(',');
+    if (comma == std::string::npos) return false;
+
+    return ParseFloat(value.substr(0, comma), result.x) && ParseFloat(value.substr(comma + 1), result.y);
+}
+
+bool LoadSettingsFile(const std::string& path, Settings& settings);
+
+bool SetSetting(Settings& settings, const std::string& key, const std::string& value) {
+    bool ok = true;
+    if (key == "config") ok = LoadSettingsFile(value, settings);
+    else if (key == "frame") ok = ParseFrame(value, settings.frame);
+    else if (key == "width") ok = ParseUnsigned(value, settings.width);
+    else if (key == "height") ok = ParseUnsigned(value, settings.height);
+    else if (key == "agents") ok = ParseUnsigned(value, settings.num_agents);
+    else if (key == "mode") ok = ParseMode(value, settings.mode);
+    else if (key == "maze") ok = ParseBool(value, settings.is_maze);
+    else if (key == "maze-file") {
+        settings.maze_file = value;
+        settings.is_maze = true;
+    }
+    else if (key == "polling") ok = ParseBool(value, settings.is_polling);
+    else if (key == "run") ok = ParseBool(value, settings.is_run);
+    else if (key == "seed") ok = ParseUnsigned(value, settings.seed);
+    else if (key == "steps") ok = ParseUnsigned(value, settings.steps);
+    else if (key == "until-converged") ok = ParseBool(value, settings.until_converged);
+    else if (key == "adaptive-population") ok = ParseBool(value, settings.adaptive_population);
+    else if (key == "threads") ok = ParseUnsigned(value, settings.threads);
+    else if (key == "reorder-every") ok = ParseUnsigned(value, settings.reorder_every);
+    else if (key == "scaling") ok = ParseBool(value, settings.scaling);
+    else if (key == "food-count") ok = ParseUnsigned(value, settings.food_count);
+    else if (key == "blur") ok = ParseBlur(value, settings.blur);
+    else if (key == "sparse-trail") ok = ParseBool(value, settings.is_sparse_trail);
+    else if (key == "ranks") ok = ParseUnsigned(value, settings.ranks) && settings.ranks >= 1;
+    else if (key == "blur-strength") ok = ParseFloat(value, settings.blur_strength) && settings.blur_strength >= 0.0f;
+    else if (key == "decay-rate") ok = ParseFloat(value, settings.decay_rate) && settings.decay_rate >= 0.0f && settings.decay_rate <= 1.0f;
+    else if (key == "speed") ok = ParseFloat(value, settings.speed) && settings.speed >= 0.0f;
+    else if (key == "rotation-angle") ok = ParseFloat(value, settings.rotation_angle);
+    else if (key == "angle-responsiveness") ok = ParseFloat(value, settings.angle_responsiveness);
+    else if (key == "sensor-distance") ok = ParseFloat(value, settings.sensor_distance) && settings.sensor_distance >= 0.0f;
+    else if (key == "sensor-angle") ok = ParseFloat(value, settings.sensor_angle);
+    else if (key == "font") settings.font_path = value;
+    else if (key == "pipeline") ok = ParseBool(value, settings.is_pipelined);
+    else if (key == "filter") settings.filter = value;
+    else if (key == "min-time") ok = ParseFloat(value, settings.min_time) && settings.min_time >= 0.0f;
+    else if (key == "output") settings.output = value;
+    else if (key == "dimension") ok = ParseUnsigned(value, settings.dimension);
+    else if (key == "evaluations") ok = ParseUnsigned(value, settings.evaluations);
+    else if (key == "target") ok = ParseFloat(value, settings.target) && settings.target >= 0.0f;
+    else if (key == "patience") ok = ParseUnsigned(value, settings.patience);
+    else if (key == "trace") settings.trace_path = value;
+    else if (key == "perf") ok = ParseBool(value, settings.perf);
+    else if (key == "check-allocations") ok = ParseBool(value, settings.check_allocations);
+    else if (key == "snapshot") settings.snapshot_path = value;
+    else if (key == "resume") settings.resume_path = value;
+    else if (key == "trajectory") settings.trajectory_path = value;
+    else if (key == "trajectory-every") ok = ParseUnsigned(value, settings.trajectory_every) && settings.trajectory_every != 0;
+    else if (key == "sweep") {
+        ok = value.find('=') != std::string::npos;
+        if (ok) settings.sweep.push_back(value);
+    }
+    else if (key == "repeats") ok = ParseUnsigned(value, settings.repeats) && settings.repeats >= 1;
+    else if (key == "food") {
+        Vector2f position;
+        ok = ParsePoint(value, position);
+        if (ok) settings.food.push_back(position);
+    }
+    else {
+        std::cerr << "Unknown setting '" << key << "'\n";
+        return false;
+    }
+
+    if (!ok) std::cerr << "Invalid value '" << value << "' for setting '" << key << "'\n";
+    return ok;
+}
+
+bool LoadSettingsFile(const std::string& path, Settings& settings) {
+    std::ifstream input(path);
+    if (!input.is_open()) {
+        std::cerr << "Error opening config file " << path << "\n";
+        return false;
+    }
+
+    const auto trim = [](const std::string& text) {
+        const size_t begin = text.find_first_not_of(" \t\r");
+        if (begin == std::string::npos) return std::string();
+        const size_t end = text.find_last_not_of(" \t\r");
+        return text.substr(begin, end - begin + 1);
+    };
+
+    std::string line;
+    for (int line_number = 1; std::getline(input, line); ++line_number) {
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) continue;
+
+        const size_t equals = line.find('=');
+        if (equals == std::string::npos) {
+            std::cerr << path << ":" << line_number << ": expected key = value\n";
+            return false;
+        }
+        if (!SetSetting(settings, trim(line.substr(0, equals)), trim(line.substr(equals + 1)))) return false;
+    }
+    return true;
+}
+
+bool ParseSettings(int argc, char** argv, Settings& settings) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            PrintUsage(argv[0]);
+            return false;
+        }
+        if (arg.rfind("--", 0) != 0) {
+            std::cerr << "Unexpected argument '" << arg << "'\n";
+            return false;
+        }
+
+        arg = arg.substr(2);
+        std::string value;
+        const size_t equals = arg.find('=');
+        if (equals != std::string::npos) {
+            value = arg.substr(equals + 1);
+            arg = arg.substr(0, equals);
+        }
+        else if (i + 1 < argc) {
+            value = argv[++i];
+        }
+        else {
+            std::cerr << "Missing value for '--" << arg << "'\n";
+            return false;
+        }
+
+        if (!SetSetting(settings, arg, value)) return false;
+    }
+    return true;
+}
+
+SimulationContext MakeContext(const Settings& settings) {
+    SimulationContext context;
+    InitiliseConfig(settings.frame, context);
+    if (settings.width != 0) context.width = settings.width;
+    if (settings.height != 0) context.height = settings.height;
+    if (settings.num_agents != 0) context.num_agents = settings.num_agents;
+
+    context.mode = settings.mode;
+    context.is_maze = settings.is_maze;
+    context.is_polling = settings.is_polling;
+    context.is_run = settings.is_run;
+
+    context.blur = settings.blur;
+    context.blur_strength = settings.blur_strength;
+    context.decay_rate = settings.decay_rate;
+    context.speed = settings.speed;
+    context.rotation_angle = settings.rotation_angle;
+    context.angle_responsiveness = settings.angle_responsiveness;
+    context.sensor_distance = settings.sensor_distance;
+    context.sensor_angle = settings.sensor_angle;
+    return context;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include "domain.h"
+
+// Everything a simulation reads besides its own buffers: the frame, the modes, the tunable
+// parameters and the SMA iteration and population state. An Engine owns one and hands it
+// down to the agents, so a process can run any number of simulations side by side. The
+// defaults are the ones in domain.h.
+struct SimulationContext {
+    unsigned width = 0;
+    unsigned height = 0;
+    unsigned num_agents = 0;
+
+    mode::Type mode = mode::CURRENT;
+    bool is_maze = mode::IS_MAZE;
+    bool is_polling = mode::IS_POLLING;
+    bool is_run = mode::IS_RUN;
+
+    diffusion::Operator blur = diffusion::CURRENT;
+    float blur_strength = simulation::BLUR_STRENGTH;
+    float decay_rate = simulation::DECAY_RATE;
+    float speed = agent::SPEED;
+    float rotation_angle = agent::ROTATION_ANGLE;
+    float angle_responsiveness = simulation::ANGLE_RESPONSIVNESS;
+    float sensor_distance = sensor::DISTANCE;
+    float sensor_angle = sensor::ANGLE;
+    float sensor_boost = sensor::BOOST;
+    int max_iteration = simulation::MAX_ITERATION;
+
+    // Advanced by the engine every step; agents only read them.
+    int iteration = 1;
+    float best_fitness = 0.0f;
+    float worst_fitness = 0.0f;
+    Vector2f best_position;
+
+    // t/T of the SMA update.
+    float GetProgress() const { return iteration / static_cast<float>(max_iteration); }
+};
@@ -0,0 +1,45 @@
+#include "domain.h"
+#include "snapshot.h"
+
+#include <iomanip>
+#include <limits>
+
+// Offline converter from a binary snapshot to the X;Y;Weight table the viewer used to save.
+int main(int argc, char** argv) {
+    if (argc < 2 || argc > 3) {
+        std::cerr << "Usage: " << argv[0] << " SNAPSHOT [OUTPUT.csv]\n"
+            << "Writes one X;Y;Weight line per agent, to agents_data.csv by default.\n";
+        return EXIT_FAILURE;
+    }
+
+    SnapshotFile snapshot;
+    if (!snapshot.Open(argv[1])) {
+        std::cerr << "Error loading snapshot '" << argv[1] << "'\n";
+        return EXIT_FAILURE;
+    }
+
+    const SnapshotHeader& header = snapshot.GetHeader();
+    const auto* x = reinterpret_cast<const float*>(snapshot.Find(snapshot::AGENT_X).data);
+    const auto* y = reinterpret_cast<const float*>(snapshot.Find(snapshot::AGENT_Y).data);
+    const auto* weight = reinterpret_cast<const float*>(snapshot.Find(snapshot::AGENT_WEIGHT).data);
+
+    const std::string output_path = argc == 3 ? argv[2] : "agents_data.csv";
+    std::ofstream output(output_path);
+    if (!output) {
+        std::cerr << "Error writing '" << output_path << "'\n";
+        return EXIT_FAILURE;
+    }
+
+    output << std::setprecision(std::numeric_limits<float>::max_digits10) << "X;Y;Weight\n";
+    for (uint64_t i = 0; i < header.agent_count; ++i) {
+        output << x[i] << ";" << y[i] << ";" << weight[i] << "\n";
+    }
+    if (!output) {
+        std::cerr << "Error writing '" << output_path << "'\n";
+        return EXIT_FAILURE;
+    }
+
+    std::cout << header.agent_count << " agents of step " << header.step_count
+        << " (" << header.width << "x" << header.height << ") written to '" << output_path << "'\n";
+    return 0;
+}
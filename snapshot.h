@@ -0,0 +1,342 @@
+#pragma once
+#include "domain.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SLIME_HAS_MMAP 1
+#endif
+
+// Binary simulation state: a fixed header, a table of sections and the sections
+// themselves, each 64-byte aligned so a mapped file can be read in place. Every
+// random draw is keyed by (seed, step), so the seed and step count are the whole RNG
+// state. Readers skip section ids they do not know; incompatible layouts bump VERSION.
+// Version 2 dropped the fitness and food target sections, which are not state; version 1
+// files still load.
+namespace snapshot {
+    const char MAGIC[8] = { 'S', 'L', 'I', 'M', 'E', 'S', 'N', 'P' };
+    const uint32_t VERSION = 2;
+    const uint32_t ENDIAN_MARK = 0x01020304;
+    const size_t ALIGNMENT = 64;
+
+    enum Section : uint32_t {
+        // Per-agent arrays, agent_count floats each. AGENT_HEADING is in degrees and written
+        // for readers of the file; the pool restores its heading from the unit vector below.
+        AGENT_X = 1,
+        AGENT_Y,
+        AGENT_HEADING,
+        AGENT_WEIGHT,
+        AGENT_FITNESS,      // version 1 only
+        AGENT_TARGET_X,     // version 1 only
+        AGENT_TARGET_Y,     // version 1 only
+        AGENT_LAST_FOOD_X,
+        AGENT_LAST_FOOD_Y,
+        TRAIL,          // width * height floats
+        FOOD,           // x, y float pairs
+        WALL_BITS,      // (width + 63) / 64 uint64 words per row; only with a maze
+        WALL_DISTANCE,  // width * height floats
+        AGENT_ID,       // agent_count uint32 random-stream ids; older files lack it, their ids are the slots
+        AGENT_COS_HEADING,  // agent_count floats each, the heading as a unit vector; older files
+        AGENT_SIN_HEADING,  // lack both and it is taken from AGENT_HEADING
+    };
+
+    // Sections of the AgentPool::GetStateArrays arrays, in their order.
+    const uint32_t AGENT_SECTIONS[] = {
+        AGENT_X, AGENT_Y, AGENT_WEIGHT, AGENT_LAST_FOOD_X, AGENT_LAST_FOOD_Y, AGENT_COS_HEADING, AGENT_SIN_HEADING
+    };
+
+    inline uint32_t GetAgentSection(size_t index) { return AGENT_SECTIONS[index]; }
+}
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t width;
+    uint32_t height;
+    uint64_t agent_count;
+    uint64_t step_count;
+    uint32_t seed;
+    int32_t iteration;
+    float best_fitness;
+    float worst_fitness;
+    float best_x;
+    float best_y;
+    uint32_t section_count;
+    uint32_t reserved;
+};
+static_assert(sizeof(SnapshotHeader) == 72, "snapshot header layout changed");
+
+struct SnapshotSectionEntry {
+    uint32_t id;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+};
+static_assert(sizeof(SnapshotSectionEntry) == 24, "snapshot section entry layout changed");
+
+// An in-memory copy of the state, taken between two steps and written out later.
+struct Snapshot {
+    struct Section {
+        uint32_t id;
+        std::vector<uint8_t> data;
+    };
+
+    SnapshotHeader header{};
+    std::vector<Section> sections;
+
+    void Add(uint32_t id, const void* data, size_t size) {
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        sections.push_back({ id, std::vector<uint8_t>(bytes, bytes + size) });
+    }
+
+    // Adds a section of `size` bytes for the caller to fill.
+    void* Add(uint32_t id, size_t size) {
+        sections.push_back({ id, std::vector<uint8_t>(size) });
+        return sections.back().data.data();
+    }
+};
+
+inline uint64_t AlignSnapshotOffset(uint64_t offset) {
+    return (offset + snapshot::ALIGNMENT - 1) / snapshot::ALIGNMENT * snapshot::ALIGNMENT;
+}
+
+// Writes to a temporary file first and renames it, so a crash never leaves a torn snapshot.
+bool WriteSnapshot(const Snapshot& snapshot, const std::string& path) {
+    SnapshotHeader header = snapshot.header;
+    std::memcpy(header.magic, snapshot::MAGIC, sizeof(header.magic));
+    header.version = snapshot::VERSION;
+    header.byte_order = snapshot::ENDIAN_MARK;
+    header.section_count = static_cast<uint32_t>(snapshot.sections.size());
+
+    std::vector<SnapshotSectionEntry> entries;
+    uint64_t offset = AlignSnapshotOffset(sizeof(header) + snapshot.sections.size() * sizeof(SnapshotSectionEntry));
+    for (const auto& section : snapshot.sections) {
+        entries.push_back({ section.id, 0, offset, section.data.size() });
+        offset = AlignSnapshotOffset(offset + section.data.size());
+    }
+
+    const std::string temporary_path = path + ".tmp";
+    {
+        std::ofstream output(temporary_path, std::ios::binary | std::ios::trunc);
+        if (!output) return false;
+
+        const char padding[snapshot::ALIGNMENT] = {};
+        const auto pad_to = [&](uint64_t position) {
+            const uint64_t current = static_cast<uint64_t>(output.tellp());
+            if (position > current) output.write(padding, static_cast<std::streamsize>(position - current));
+        };
+
+        output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        output.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(SnapshotSectionEntry));
+        for (size_t i = 0; i < entries.size(); ++i) {
+            pad_to(entries[i].offset);
+            output.write(reinterpret_cast<const char*>(snapshot.sections[i].data.data()), snapshot.sections[i].data.size());
+        }
+        if (!output) return false;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary_path, path, error);
+    return !error;
+}
+
+// Writes snapshots on its own thread so the caller only pays for the copy. A snapshot
+// submitted while another one still waits replaces it; the destructor finishes the queue.
+class SnapshotWriter {
+public:
+    SnapshotWriter() : thread_([this] { WriterLoop(); }) {}
+
+    ~SnapshotWriter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_one();
+        thread_.join();
+    }
+
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    void Submit(std::unique_ptr<Snapshot> snapshot, const std::string& path) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_ = std::move(snapshot);
+            pending_path_ = path;
+        }
+        wake_.notify_one();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::unique_ptr<Snapshot> pending_;
+    std::string pending_path_;
+    bool stop_ = false;
+    std::thread thread_;
+
+    void WriterLoop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            wake_.wait(lock, [this] { return stop_ || pending_; });
+            if (!pending_) return;
+
+            const std::unique_ptr<Snapshot> snapshot = std::move(pending_);
+            const std::string path = pending_path_;
+            lock.unlock();
+
+            const auto start = std::chrono::steady_clock::now();
+            if (WriteSnapshot(*snapshot, path)) {
+                const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                std::cout << "Snapshot of step " << snapshot->header.step_count << " written to '" << path
+                    << "' in " << elapsed.count() << " s\n";
+            }
+            else {
+                std::cerr << "Error writing snapshot '" << path << "'\n";
+            }
+            lock.lock();
+        }
+    }
+};
+
+// A snapshot file mapped read-only (read into memory where mmap is unavailable). Open
+// checks the header and that every known section has the size the header implies.
+class SnapshotFile {
+public:
+    struct SectionView {
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+    };
+
+    SnapshotFile() = default;
+    ~SnapshotFile() { Close(); }
+
+    SnapshotFile(const SnapshotFile&) = delete;
+    SnapshotFile& operator=(const SnapshotFile&) = delete;
+
+    bool Open(const std::string& path) {
+        Close();
+        if (!Map(path) || size_ < sizeof(SnapshotHeader)) return false;
+
+        std::memcpy(&header_, data_, sizeof(header_));
+        if (std::memcmp(header_.magic, snapshot::MAGIC, sizeof(header_.magic)) != 0) return false;
+        if (header_.version == 0 || header_.version > snapshot::VERSION || header_.byte_order != snapshot::ENDIAN_MARK) return false;
+
+        const uint64_t table_end = sizeof(SnapshotHeader) + static_cast<uint64_t>(header_.section_count) * sizeof(SnapshotSectionEntry);
+        if (table_end > size_) return false;
+        entries_.resize(header_.section_count);
+        std::memcpy(entries_.data(), data_ + sizeof(SnapshotHeader), entries_.size() * sizeof(SnapshotSectionEntry));
+        for (const auto& entry : entries_) {
+            if (entry.offset % snapshot::ALIGNMENT != 0 || entry.offset > size_ || entry.size > size_ - entry.offset) return false;
+        }
+        return HasValidSections();
+    }
+
+    const SnapshotHeader& GetHeader() const { return header_; }
+
+    // An empty view when the section is missing.
+    SectionView Find(uint32_t id) const {
+        for (const auto& entry : entries_) {
+            if (entry.id == id) return { data_ + entry.offset, static_cast<size_t>(entry.size) };
+        }
+        return {};
+    }
+
+    // Copies a section whose size is already known to match.
+    void Copy(uint32_t id, void* destination) const {
+        const SectionView section = Find(id);
+        if (section.size != 0) std::memcpy(destination, section.data, section.size);
+    }
+
+private:
+    SnapshotHeader header_{};
+    std::vector<SnapshotSectionEntry> entries_;
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+#if SLIME_HAS_MMAP
+    void* mapping_ = nullptr;
+#else
+    std::vector<uint8_t> contents_;
+#endif
+
+    bool HasValidSections() const {
+        const uint64_t pixels = static_cast<uint64_t>(header_.width) * header_.height;
+        if (header_.agent_count == 0 || pixels == 0) return false;
+
+        for (uint32_t id : { snapshot::AGENT_X, snapshot::AGENT_Y, snapshot::AGENT_HEADING, snapshot::AGENT_WEIGHT,
+            snapshot::AGENT_LAST_FOOD_X, snapshot::AGENT_LAST_FOOD_Y }) {
+            if (Find(id).size != header_.agent_count * sizeof(float)) return false;
+        }
+        if (Find(snapshot::TRAIL).size != pixels * sizeof(float)) return false;
+        if (Find(snapshot::FOOD).size % sizeof(Vector2f) != 0) return false;
+        const size_t ids = Find(snapshot::AGENT_ID).size;
+        if (ids != 0 && ids != header_.agent_count * sizeof(uint32_t)) return false;
+        const size_t directions = Find(snapshot::AGENT_COS_HEADING).size;
+        if (directions != Find(snapshot::AGENT_SIN_HEADING).size) return false;
+        if (directions != 0 && directions != header_.agent_count * sizeof(float)) return false;
+
+        const size_t wall_bits = Find(snapshot::WALL_BITS).size;
+        const size_t wall_distance = Find(snapshot::WALL_DISTANCE).size;
+        if (wall_bits == 0 && wall_distance == 0) return true;
+        return wall_bits == (header_.width + 63) / 64 * static_cast<uint64_t>(header_.height) * sizeof(uint64_t)
+            && wall_distance == pixels * sizeof(float);
+    }
+
+#if SLIME_HAS_MMAP
+    bool Map(const std::string& path) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+
+        struct stat status;
+        if (fstat(fd, &status) != 0 || status.st_size <= 0) {
+            close(fd);
+            return false;
+        }
+        size_ = static_cast<size_t>(status.st_size);
+        void* mapping = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            size_ = 0;
+            return false;
+        }
+        mapping_ = mapping;
+        data_ = static_cast<const uint8_t*>(mapping);
+        return true;
+    }
+
+    void Close() {
+        if (mapping_) munmap(mapping_, size_);
+        mapping_ = nullptr;
+        data_ = nullptr;
+        size_ = 0;
+        entries_.clear();
+    }
+#else
+    bool Map(const std::string& path) {
+        std::ifstream input(path, std::ios::binary);
+        if (!input) return false;
+        contents_.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+        data_ = contents_.data();
+        size_ = contents_.size();
+        return true;
+    }
+
+    void Close() {
+        contents_.clear();
+        data_ = nullptr;
+        size_ = 0;
+        entries_.clear();
+    }
+#endif
+};
@@ -0,0 +1,90 @@
+#pragma once
+#include "domain.h"
+#include "parallel.h"
+
+#include <array>
+
+// Z-order index of a pixel: nearby pixels get nearby codes, so agents sorted by it
+// touch nearby trail map memory.
+inline uint32_t MortonCode(uint32_t x, uint32_t y) {
+    const auto spread = [](uint32_t v) {
+        v &= 0x0000ffff;
+        v = (v | (v << 8)) & 0x00ff00ff;
+        v = (v | (v << 4)) & 0x0f0f0f0f;
+        v = (v | (v << 2)) & 0x33333333;
+        v = (v | (v << 1)) & 0x55555555;
+        return v;
+    };
+    return spread(x) | (spread(y) << 1);
+}
+
+// Stable LSD radix sort of 32-bit keys, eight bits per pass. Each pass histograms and
+// scatters fixed-size chunks in parallel; chunk offsets are summed in chunk order, so
+// the result does not depend on the thread count. Scratch is kept between sorts.
+class RadixSorter {
+public:
+    // Fills `order` with the indices of `keys` in ascending key order.
+    void Sort(const std::vector<uint32_t>& keys, std::vector<uint32_t>& order, ThreadPool& pool) {
+        const size_t count = keys.size();
+        const size_t chunk_count = (count + ITEMS_PER_CHUNK - 1) / ITEMS_PER_CHUNK;
+        keys_[0].assign(keys.begin(), keys.end());
+        keys_[1].resize(count);
+        order.resize(count);
+        order_scratch_.resize(count);
+        histograms_.resize(chunk_count);
+
+        pool.ParallelFor(count, ITEMS_PER_CHUNK, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) order[i] = static_cast<uint32_t>(i);
+            });
+
+        std::vector<uint32_t>* src_order = &order;
+        std::vector<uint32_t>* dst_order = &order_scratch_;
+        size_t src = 0;
+        for (unsigned shift = 0; shift < 32; shift += 8) {
+            pool.Run(chunk_count, [&](size_t chunk) {
+                auto& histogram = histograms_[chunk];
+                histogram.fill(0);
+                const size_t begin = chunk * ITEMS_PER_CHUNK;
+                const size_t end = std::min(count, begin + ITEMS_PER_CHUNK);
+                for (size_t i = begin; i < end; ++i) ++histogram[(keys_[src][i] >> shift) & 0xff];
+                });
+
+            // Turn the counts into each chunk's first output slot per digit.
+            size_t offset = 0;
+            bool is_single_digit = false;
+            for (size_t digit = 0; digit < 256; ++digit) {
+                size_t digit_total = 0;
+                for (auto& histogram : histograms_) {
+                    const size_t chunk_count_for_digit = histogram[digit];
+                    histogram[digit] = offset + digit_total;
+                    digit_total += chunk_count_for_digit;
+                }
+                if (digit_total == count) is_single_digit = true;
+                offset += digit_total;
+            }
+            if (is_single_digit) continue;
+
+            pool.Run(chunk_count, [&](size_t chunk) {
+                auto& slots = histograms_[chunk];
+                const size_t begin = chunk * ITEMS_PER_CHUNK;
+                const size_t end = std::min(count, begin + ITEMS_PER_CHUNK);
+                for (size_t i = begin; i < end; ++i) {
+                    const size_t slot = slots[(keys_[src][i] >> shift) & 0xff]++;
+                    keys_[1 - src][slot] = keys_[src][i];
+                    (*dst_order)[slot] = (*src_order)[i];
+                }
+                });
+            src = 1 - src;
+            std::swap(src_order, dst_order);
+        }
+
+        if (src_order != &order) order.swap(order_scratch_);
+    }
+
+private:
+    static constexpr size_t ITEMS_PER_CHUNK = 1 << 16;
+
+    std::vector<uint32_t> keys_[2];
+    std::vector<uint32_t> order_scratch_;
+    std::vector<std::array<size_t, 256>> histograms_;
+};
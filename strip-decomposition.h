@@ -0,0 +1,159 @@
+#pragma once
+#include "decomposition.h"
+#include "communicator.h"
+
+// The world cut into horizontal strips of whole trail tile rows, one per rank, with one
+// tile row of halo on either side. That is enough for a step only while the blur reach
+// and an agent's step plus sensor distance stay within a 64 pixel tile; slime_distributed
+// rejects settings that go further. Food and walls are small and every rank keeps all
+// of them.
+class StripDecomposition : public Decomposition {
+public:
+    StripDecomposition(Communicator& communicator, const SimulationContext& context)
+        : communicator_(communicator), width_(context.width), height_(context.height), agent_count_(context.num_agents) {
+        const unsigned tile_rows = (height_ + TiledField::TILE - 1) / TiledField::TILE;
+        for (unsigned r = 0; r <= communicator_.GetSize(); ++r) {
+            first_rows_.push_back(static_cast<unsigned>(static_cast<uint64_t>(tile_rows) * r / communicator_.GetSize()));
+        }
+        outgoing_.resize(communicator_.GetSize());
+    }
+
+    unsigned GetFirstTileRow() const override { return first_rows_[communicator_.GetRank()]; }
+    unsigned GetEndTileRow() const override { return first_rows_[communicator_.GetRank() + 1]; }
+
+    bool OwnsRow(float y) const override { return GetOwner(ClampRow(y)) == communicator_.GetRank(); }
+
+    void ReduceFitness(FitnessRange& range, float& best_agent_fitness, Vector2f& best_position) override {
+        const FitnessCandidate local = { range, best_agent_fitness, best_position };
+        std::vector<FitnessCandidate> candidates;
+        communicator_.AllGatherValue(local, candidates);
+
+        range = { std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest() };
+        best_agent_fitness = std::numeric_limits<float>::max();
+        for (const FitnessCandidate& candidate : candidates) {
+            range.best = std::min(range.best, candidate.range.best);
+            range.worst = std::max(range.worst, candidate.range.worst);
+            if (candidate.best_agent_fitness < best_agent_fitness) {
+                best_agent_fitness = candidate.best_agent_fitness;
+                best_position = candidate.best_position;
+            }
+        }
+    }
+
+    // Every agent is in the sample with the same probability, decided by its id, and the
+    // sample is sorted by id, so it is the same whichever rank holds which agent.
+    bool GatherPartners(const AgentPool& agents, const RandomStream& random, std::vector<Vector2f>& partners) override {
+        if (communicator_.GetSize() == 1) return false;
+
+        const float rate = std::min(1.0f, static_cast<float>(simulation::PARTNER_SAMPLE_SIZE) / agent_count_);
+        std::vector<uint8_t> local;
+        for (size_t i = 0; i < agents.Size(); ++i) {
+            const uint32_t id = agents.GetId(i);
+            if (random.Uniform(id, draw::PARTNER_SAMPLE) >= rate) continue;
+            const Partner partner = { id, agents.GetPos(i) };
+            const size_t offset = local.size();
+            local.resize(offset + sizeof(Partner));
+            std::memcpy(&local[offset], &partner, sizeof(Partner));
+        }
+
+        std::vector<std::vector<uint8_t>> gathered;
+        communicator_.AllGather(local, gathered);
+        samples_.clear();
+        for (const auto& bytes : gathered) {
+            const size_t first = samples_.size();
+            samples_.resize(first + bytes.size() / sizeof(Partner));
+            if (!bytes.empty()) std::memcpy(&samples_[first], bytes.data(), bytes.size());
+        }
+        if (samples_.empty()) return false;
+
+        std::sort(samples_.begin(), samples_.end(), [](const Partner& a, const Partner& b) { return a.id < b.id; });
+        partners.resize(samples_.size());
+        for (size_t k = 0; k < samples_.size(); ++k) partners[k] = samples_[k].position;
+        return true;
+    }
+
+    void ExchangeHalo(TrailMap& trail_map) override {
+        TiledField& tiles = trail_map.GetTiles();
+        const unsigned rank = communicator_.GetRank();
+        if (rank > 0) tiles.WriteTileRow(GetFirstTileRow(), outgoing_[rank - 1]);
+        if (rank + 1 < communicator_.GetSize()) tiles.WriteTileRow(GetEndTileRow() - 1, outgoing_[rank + 1]);
+
+        communicator_.AllToAll(outgoing_, incoming_);
+        if (rank > 0) tiles.ReadTileRow(GetFirstTileRow() - 1, incoming_[rank - 1].data());
+        if (rank + 1 < communicator_.GetSize()) tiles.ReadTileRow(GetEndTileRow(), incoming_[rank + 1].data());
+    }
+
+    void RouteDeposits(std::vector<uint32_t>& pixels) override {
+        const unsigned rank = communicator_.GetRank();
+        size_t kept = 0;
+        for (uint32_t pixel : pixels) {
+            const unsigned owner = GetOwner(pixel / width_);
+            if (owner == rank) {
+                pixels[kept++] = pixel;
+                continue;
+            }
+            const size_t offset = outgoing_[owner].size();
+            outgoing_[owner].resize(offset + sizeof(uint32_t));
+            std::memcpy(&outgoing_[owner][offset], &pixel, sizeof(uint32_t));
+        }
+        pixels.resize(kept);
+
+        communicator_.AllToAll(outgoing_, incoming_);
+        for (unsigned r = 0; r < communicator_.GetSize(); ++r) {
+            if (r == rank) continue;
+            const size_t first = pixels.size();
+            pixels.resize(first + incoming_[r].size() / sizeof(uint32_t));
+            if (!incoming_[r].empty()) std::memcpy(&pixels[first], incoming_[r].data(), incoming_[r].size());
+        }
+    }
+
+    void MigrateAgents(AgentPool& agents) override {
+        const unsigned rank = communicator_.GetRank();
+        keep_.assign(agents.Size(), 1);
+        bool is_leaving = false;
+        for (size_t i = 0; i < agents.Size(); ++i) {
+            const unsigned owner = GetOwner(ClampRow(agents.GetPos(i).y));
+            if (owner == rank) continue;
+            agents.WriteRecord(i, outgoing_[owner]);
+            keep_[i] = 0;
+            is_leaving = true;
+        }
+        if (is_leaving) agents.Compact(keep_);
+
+        communicator_.AllToAll(outgoing_, incoming_);
+        for (unsigned r = 0; r < communicator_.GetSize(); ++r) {
+            if (r != rank && !incoming_[r].empty()) agents.AppendRecords(incoming_[r].data(), incoming_[r].size() / AgentPool::RECORD_BYTES);
+        }
+    }
+
+private:
+    struct FitnessCandidate {
+        FitnessRange range;
+        float best_agent_fitness;
+        Vector2f best_position;
+    };
+
+    struct Partner {
+        uint32_t id;
+        Vector2f position;
+    };
+
+    Communicator& communicator_;
+    unsigned width_;
+    unsigned height_;
+    unsigned agent_count_;
+    std::vector<unsigned> first_rows_;
+    std::vector<std::vector<uint8_t>> outgoing_;
+    std::vector<std::vector<uint8_t>> incoming_;
+    std::vector<Partner> samples_;
+    std::vector<uint8_t> keep_;
+
+    unsigned ClampRow(float y) const {
+        return static_cast<unsigned>(std::clamp(y, 0.0f, static_cast<float>(height_ - 1)));
+    }
+
+    unsigned GetOwner(unsigned row) const {
+        const unsigned tile_row = row / TiledField::TILE;
+        return static_cast<unsigned>(std::upper_bound(first_rows_.begin(), first_rows_.end(), tile_row) - first_rows_.begin()) - 1;
+    }
+};
@@ -0,0 +1,130 @@
+#include "domain.h"
+#include "settings.h"
+#include "engine.h"
+
+#include <chrono>
+
+// One axis of the grid: a setting and the values it takes.
+struct SweepAxis {
+    std::string key;
+    std::vector<std::string> values;
+};
+
+// A single simulation of the grid and what it converged to.
+struct SweepRun {
+    Settings settings;
+    std::vector<std::string> values;
+    unsigned long long steps = 0;
+    bool is_converged = false;
+    float trail_change = 0.0f;
+    float smoothed_trail_change = 0.0f;
+    size_t agents = 0;
+    double seconds = 0.0;
+};
+
+bool ParseAxis(const std::string& text, SweepAxis& axis) {
+    const size_t equals = text.find('=');
+    axis.key = text.substr(0, equals);
+    std::string values = text.substr(equals + 1);
+    for (size_t begin = 0; begin <= values.size();) {
+        const size_t comma = std::min(values.find(',', begin), values.size());
+        if (comma > begin) axis.values.push_back(values.substr(begin, comma - begin));
+        begin = comma + 1;
+    }
+    if (axis.key.empty() || axis.values.empty()) {
+        std::cerr << "Invalid sweep axis '" << text << "', expected KEY=V1,V2,...\n";
+        return false;
+    }
+    return true;
+}
+
+// The grid in row-major order, last axis fastest, each point --repeats times with the seed
+// counting up from the point's own, which a seed axis sets. Every value is checked against
+// its setting before anything runs.
+bool BuildRuns(const Settings& settings, const std::vector<SweepAxis>& axes, std::vector<SweepRun>& runs) {
+    size_t points = 1;
+    for (const SweepAxis& axis : axes) points *= axis.values.size();
+
+    for (size_t point = 0; point < points; ++point) {
+        SweepRun run;
+        run.settings = settings;
+        run.settings.threads = 1;
+        size_t remainder = point;
+        run.values.resize(axes.size());
+        for (size_t a = axes.size(); a-- > 0;) {
+            const std::string& value = axes[a].values[remainder % axes[a].values.size()];
+            remainder /= axes[a].values.size();
+            if (!SetSetting(run.settings, axes[a].key, value)) return false;
+            run.values[a] = value;
+        }
+        for (unsigned repeat = 0; repeat < settings.repeats; ++repeat) {
+            runs.push_back(run);
+            runs.back().settings.seed = run.settings.seed + repeat;
+        }
+    }
+    return true;
+}
+
+// Runs until the trail network settles or --steps is reached.
+void Simulate(SweepRun& run) {
+    const auto start = std::chrono::steady_clock::now();
+    Engine engine(run.settings);
+    engine.TrackConvergence(true);
+    for (; run.steps < run.settings.steps && !engine.IsConverged(); ++run.steps) engine.Step();
+    run.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const ConvergenceState& convergence = engine.GetConvergence();
+    run.is_converged = convergence.is_converged;
+    run.trail_change = convergence.trail_change;
+    run.smoothed_trail_change = convergence.smoothed_trail_change;
+    run.agents = engine.GetAgents().Size();
+}
+
+void WriteTable(std::ostream& output, const std::vector<SweepAxis>& axes, const std::vector<SweepRun>& runs) {
+    output << "run;seed";
+    for (const SweepAxis& axis : axes) output << ";" << axis.key;
+    output << ";steps;converged;trail_change;smoothed_trail_change;agents;seconds;steps/sec\n";
+    for (size_t r = 0; r < runs.size(); ++r) {
+        const SweepRun& run = runs[r];
+        output << r << ";" << run.settings.seed;
+        for (const std::string& value : run.values) output << ";" << value;
+        output << ";" << run.steps << ";" << (run.is_converged ? 1 : 0)
+            << ";" << run.trail_change << ";" << run.smoothed_trail_change << ";" << run.agents
+            << ";" << run.seconds << ";" << (run.seconds > 0 ? run.steps / run.seconds : 0.0) << "\n";
+    }
+}
+
+int main(int argc, char** argv) {
+    Settings settings;
+    if (!ParseSettings(argc, argv, settings)) return EXIT_FAILURE;
+    if (settings.seed == 0) settings.seed = 1;
+    if (!settings.snapshot_path.empty() || !settings.resume_path.empty() || !settings.trajectory_path.empty()) {
+        std::cerr << "Snapshots and trajectories are not written by sweep runs\n";
+        return EXIT_FAILURE;
+    }
+
+    std::vector<SweepAxis> axes(settings.sweep.size());
+    for (size_t a = 0; a < axes.size(); ++a) {
+        if (!ParseAxis(settings.sweep[a], axes[a])) return EXIT_FAILURE;
+    }
+    std::vector<SweepRun> runs;
+    if (!BuildRuns(settings, axes, runs)) return EXIT_FAILURE;
+
+    // Each simulation keeps to one thread; the pool runs as many of them at once as it has.
+    ThreadPool pool(settings.threads);
+    std::cerr << runs.size() << " runs on " << pool.GetThreadCount() << " threads\n";
+    const auto start = std::chrono::steady_clock::now();
+    pool.Run(runs.size(), [&](size_t r) { Simulate(runs[r]); });
+    std::cerr << "Done in " << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s\n";
+
+    WriteTable(std::cout, axes, runs);
+    if (!settings.output.empty()) {
+        std::ofstream output(settings.output);
+        if (!output) {
+            std::cerr << "Error writing '" << settings.output << "'\n";
+            return EXIT_FAILURE;
+        }
+        WriteTable(output, axes, runs);
+    }
+    return 0;
+}
@@ -0,0 +1,205 @@
+#pragma once
+#include "domain.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+
+// Scoped timers for the hot path. Every thread records into its own ring buffer without
+// taking a lock; readers copy the ring and keep only the events the owner cannot have
+// overwritten meanwhile. The buffers can be exported as Chrome/Perfetto trace JSON or
+// summed into a per-phase breakdown. With tracing switched off a scope costs one relaxed
+// load and a branch, and building with SLIME_TRACING=0 removes the scopes altogether.
+#ifndef SLIME_TRACING
+#define SLIME_TRACING 1
+#endif
+
+namespace trace {
+    const size_t EVENTS_PER_THREAD = 1 << 16;
+
+    // Toggled from the UI thread while simulation threads read it.
+    std::atomic<bool> ENABLED{ false };
+
+    struct Event {
+        const char* name;
+        int64_t start;
+        int64_t duration;
+    };
+
+    struct PhaseTime {
+        std::string name;
+        int64_t total = 0;
+        size_t count = 0;
+    };
+
+    int64_t Now() {
+        static const auto epoch = std::chrono::steady_clock::now();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    // A single-writer ring. The owner claims an event's index before it writes the slot and
+    // publishes it after, so an event a reader copied is intact if the owner had not yet
+    // claimed the index that reuses its slot once the copy was done.
+    class ThreadBuffer {
+    public:
+        explicit ThreadBuffer(unsigned id) : id_(id), slots_(EVENTS_PER_THREAD) {}
+
+        // Owner thread only.
+        void Record(const Event& event) {
+            const size_t index = published_.load(std::memory_order_relaxed);
+            claimed_.store(index + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            Slot& slot = slots_[index % slots_.size()];
+            slot.name.store(event.name, std::memory_order_relaxed);
+            slot.start.store(event.start, std::memory_order_relaxed);
+            slot.duration.store(event.duration, std::memory_order_relaxed);
+            published_.store(index + 1, std::memory_order_release);
+        }
+
+        // Hides the events recorded so far from later reads.
+        void Clear() {
+            first_visible_.store(published_.load(std::memory_order_acquire), std::memory_order_relaxed);
+        }
+
+        unsigned GetId() const { return id_; }
+
+        // Oldest to newest among the events still in the ring.
+        template <typename Visitor>
+        void ForEach(const Visitor& visit) const {
+            const size_t end = published_.load(std::memory_order_acquire);
+            const size_t begin = std::max(end - std::min(end, slots_.size()), first_visible_.load(std::memory_order_relaxed));
+            std::vector<Event> events;
+            events.reserve(end > begin ? end - begin : 0);
+            for (size_t i = begin; i < end; ++i) {
+                const Slot& slot = slots_[i % slots_.size()];
+                events.push_back({ slot.name.load(std::memory_order_relaxed), slot.start.load(std::memory_order_relaxed),
+                    slot.duration.load(std::memory_order_relaxed) });
+            }
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            const size_t claimed = claimed_.load(std::memory_order_relaxed);
+            const size_t intact = claimed > slots_.size() ? claimed - slots_.size() : 0;
+            for (size_t i = begin; i < end; ++i) {
+                if (i >= intact) visit(events[i - begin]);
+            }
+        }
+
+    private:
+        struct Slot {
+            std::atomic<const char*> name{ nullptr };
+            std::atomic<int64_t> start{ 0 };
+            std::atomic<int64_t> duration{ 0 };
+        };
+
+        unsigned id_;
+        std::vector<Slot> slots_;
+        std::atomic<size_t> published_{ 0 };
+        std::atomic<size_t> claimed_{ 0 };
+        std::atomic<size_t> first_visible_{ 0 };
+    };
+
+    std::mutex REGISTRY_MUTEX;
+    std::vector<std::unique_ptr<ThreadBuffer>> BUFFERS;
+
+    ThreadBuffer& GetThreadBuffer() {
+        thread_local ThreadBuffer* buffer = nullptr;
+        if (buffer == nullptr) {
+            std::lock_guard<std::mutex> lock(REGISTRY_MUTEX);
+            BUFFERS.push_back(std::make_unique<ThreadBuffer>(static_cast<unsigned>(BUFFERS.size())));
+            buffer = BUFFERS.back().get();
+        }
+        return *buffer;
+    }
+
+    class Scope {
+    public:
+        explicit Scope(const char* name)
+            : name_(ENABLED.load(std::memory_order_relaxed) ? name : nullptr), start_(name_ ? Now() : 0) {}
+
+        ~Scope() {
+            if (name_) GetThreadBuffer().Record({ name_, start_, Now() - start_ });
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        const char* name_;
+        int64_t start_;
+    };
+
+    // The functions below read every thread's buffer. Scopes still open are not in it yet.
+    void Clear() {
+        std::lock_guard<std::mutex> lock(REGISTRY_MUTEX);
+        for (auto& buffer : BUFFERS) buffer->Clear();
+    }
+
+    void WriteChromeTrace(std::ostream& output) {
+        std::lock_guard<std::mutex> lock(REGISTRY_MUTEX);
+        output << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool is_first = true;
+        for (const auto& buffer : BUFFERS) {
+            output << (is_first ? "\n" : ",\n")
+                << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << buffer->GetId()
+                << ",\"args\":{\"name\":\"" << (buffer->GetId() == 0 ? "main" : "worker " + std::to_string(buffer->GetId())) << "\"}}";
+            is_first = false;
+            buffer->ForEach([&](const Event& event) {
+                output << ",\n{\"ph\":\"X\",\"name\":\"" << event.name << "\",\"pid\":1,\"tid\":" << buffer->GetId()
+                    << ",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << event.duration / 1000.0 << "}";
+                });
+        }
+        output << "\n]}\n";
+    }
+
+    // Time per phase over the last `window` nanoseconds, summed over all threads, longest first.
+    std::vector<PhaseTime> Breakdown(int64_t window) {
+        std::lock_guard<std::mutex> lock(REGISTRY_MUTEX);
+        const int64_t since = Now() - window;
+        std::map<std::string, PhaseTime> phases;
+        for (const auto& buffer : BUFFERS) {
+            buffer->ForEach([&](const Event& event) {
+                if (event.start < since) return;
+                PhaseTime& phase = phases[event.name];
+                phase.total += event.duration;
+                ++phase.count;
+                });
+        }
+
+        std::vector<PhaseTime> result;
+        for (auto& [name, phase] : phases) {
+            phase.name = name;
+            result.push_back(phase);
+        }
+        std::sort(result.begin(), result.end(), [](const PhaseTime& a, const PhaseTime& b) { return a.total > b.total; });
+        return result;
+    }
+
+    // One line per phase: milliseconds per `per` scope (a frame or a step) and calls per `per`.
+    std::string FormatBreakdown(const std::vector<PhaseTime>& phases, const std::string& per) {
+        size_t per_count = 0;
+        for (const auto& phase : phases) {
+            if (phase.name == per) per_count = phase.count;
+        }
+        if (per_count == 0) return std::string();
+
+        std::string text;
+        char line[128];
+        for (const auto& phase : phases) {
+            std::snprintf(line, sizeof(line), "%-16s %8.3f ms  x%.2f\n", phase.name.c_str(),
+                phase.total / 1e6 / per_count, static_cast<double>(phase.count) / per_count);
+            text += line;
+        }
+        return text;
+    }
+}
+
+#define SLIME_TRACE_CONCAT_INNER(a, b) a##b
+#define SLIME_TRACE_CONCAT(a, b) SLIME_TRACE_CONCAT_INNER(a, b)
+#if SLIME_TRACING
+#define SLIME_TRACE_SCOPE(name) const trace::Scope SLIME_TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#else
+#define SLIME_TRACE_SCOPE(name) do {} while (false)
+#endif
@@ -0,0 +1,141 @@
+#pragma once
+#include "domain.h"
+#include "parallel.h"
+#include "diffusion.h"
+#include "tiled-field.h"
+
+// Single-channel pheromone field, the simulation's source of truth. Values use the
+// scale of the former RGBA trail texture's channel mean, capped at simulation::TRAIL_MAX.
+// A sparse map keeps the field in a TiledField, for worlds where a dense buffer would not
+// fit; the interface is the same.
+class TrailMap {
+public:
+    TrailMap() = default;
+
+    TrailMap(unsigned width, unsigned height, bool is_sparse = false)
+        : width_(width)
+        , height_(height)
+        , is_sparse_(is_sparse) {
+        if (is_sparse_) {
+            tiles_ = TiledField(width, height);
+        }
+        else {
+            values_.assign(static_cast<size_t>(width) * height, 0.0f);
+            buffer_.assign(values_.size(), 0.0f);
+        }
+    }
+
+    unsigned GetWidth() const { return width_; }
+    unsigned GetHeight() const { return height_; }
+    size_t GetSize() const { return static_cast<size_t>(width_) * height_; }
+    bool IsSparse() const { return is_sparse_; }
+    const TiledField& GetTiles() const { return tiles_; }
+    TiledField& GetTiles() { return tiles_; }
+
+    size_t GetMemoryBytes() const {
+        return is_sparse_ ? tiles_.GetMemoryBytes() : (values_.size() + buffer_.size()) * sizeof(float);
+    }
+
+    float GetValue(unsigned x, unsigned y) const {
+        if (is_sparse_) return tiles_.GetValue(x, y);
+        return values_[static_cast<size_t>(y) * width_ + x];
+    }
+
+    void SetValue(unsigned x, unsigned y, float value) {
+        if (is_sparse_) tiles_.At(x, y) = value;
+        else values_[static_cast<size_t>(y) * width_ + x] = value;
+    }
+
+    void AddValue(unsigned x, unsigned y, float amount) {
+        if (is_sparse_) {
+            float& value = tiles_.At(x, y);
+            value = std::min(simulation::TRAIL_MAX, value + amount);
+        }
+        else {
+            AddValue(static_cast<size_t>(y) * width_ + x, amount);
+        }
+    }
+
+    void AddValue(size_t index, float amount) {
+        if (is_sparse_) AddValue(static_cast<unsigned>(index % width_), static_cast<unsigned>(index / width_), amount);
+        else values_[index] = std::min(simulation::TRAIL_MAX, values_[index] + amount);
+    }
+
+    // Makes sure the tile holding (x, y) exists, so threads can then add to it without
+    // taking tiles from the pool. A dense map has nothing to do.
+    void PrepareTile(unsigned x, unsigned y) {
+        if (is_sparse_) tiles_.At(x, y);
+    }
+
+    void Clear() {
+        if (is_sparse_) tiles_.Clear();
+        else std::fill(values_.begin(), values_.end(), 0.0f);
+    }
+
+    void CopyRow(unsigned y, float* out) const {
+        if (is_sparse_) tiles_.CopyRow(y, out);
+        else std::copy(&values_[static_cast<size_t>(y) * width_], &values_[static_cast<size_t>(y) * width_] + width_, out);
+    }
+
+    // The whole field as width * height floats, row by row.
+    void CopyTo(float* out) const {
+        for (unsigned y = 0; y < height_; ++y) CopyRow(y, out + static_cast<size_t>(y) * width_);
+    }
+
+    void CopyFrom(const float* in) {
+        for (unsigned y = 0; y < height_; ++y) {
+            const float* row = in + static_cast<size_t>(y) * width_;
+            if (is_sparse_) tiles_.SetRow(y, row);
+            else std::copy(row, row + width_, &values_[static_cast<size_t>(y) * width_]);
+        }
+    }
+
+    // RGBA8 copy for display; only the viewer pays for it, and only when it draws.
+    void ExportRgba(std::vector<uint8_t>& rgba) const {
+        rgba.resize(GetSize() * 4);
+        std::vector<float> row(is_sparse_ ? width_ : 0);
+        for (unsigned y = 0; y < height_; ++y) {
+            const float* values = values_.data();
+            if (is_sparse_) {
+                tiles_.CopyRow(y, row.data());
+                values = row.data();
+            }
+            else {
+                values += static_cast<size_t>(y) * width_;
+            }
+
+            uint8_t* out = &rgba[static_cast<size_t>(y) * width_ * 4];
+            for (unsigned x = 0; x < width_; ++x) {
+                const float value = std::min(values[x], 255.0f);
+                out[x * 4 + 0] = static_cast<uint8_t>(value * 0.04f);
+                out[x * 4 + 1] = static_cast<uint8_t>(value * 0.04f);
+                out[x * 4 + 2] = static_cast<uint8_t>(value);
+                out[x * 4 + 3] = 255;
+            }
+        }
+    }
+
+    // Multiplies the field by `rate` and blurs it with the chosen operator in one fused pass.
+    void Diffuse(float rate, float strength, diffusion::Operator blur, ThreadPool& pool) {
+        if (is_sparse_) {
+            tiles_.Diffuse(rate, strength, blur, simulation::TRAIL_TILE_FREE_BELOW, pool);
+            return;
+        }
+        diffuser_.Apply(values_, buffer_, width_, height_, rate, strength, blur, pool);
+        values_.swap(buffer_);
+    }
+
+    // Sparse maps only: diffuses tile rows [first_tile_row, end_tile_row) and drops the rest.
+    void Diffuse(float rate, float strength, diffusion::Operator blur, ThreadPool& pool, unsigned first_tile_row, unsigned end_tile_row) {
+        tiles_.Diffuse(rate, strength, blur, simulation::TRAIL_TILE_FREE_BELOW, pool, first_tile_row, end_tile_row);
+    }
+
+private:
+    unsigned width_ = 0;
+    unsigned height_ = 0;
+    bool is_sparse_ = false;
+    std::vector<float> values_;
+    std::vector<float> buffer_;
+    Diffuser diffuser_;
+    TiledField tiles_;
+};
@@ -0,0 +1,53 @@
+#include "domain.h"
+#include "settings.h"
+#include "trajectory.h"
+
+#include <iomanip>
+
+// Offline reader for --trajectory files: prints what was recorded, and with a step
+// writes that frame as an X;Y;Weight table.
+int main(int argc, char** argv) {
+    if (argc < 2 || argc > 4) {
+        std::cerr << "Usage: " << argv[0] << " TRAJECTORY [STEP [OUTPUT.csv]]\n"
+            << "Without STEP prints a summary; with it writes the frame recorded at or before STEP.\n";
+        return EXIT_FAILURE;
+    }
+
+    TrajectoryReader reader;
+    if (!reader.Open(argv[1])) {
+        std::cerr << "Error loading trajectory '" << argv[1] << "'\n";
+        return EXIT_FAILURE;
+    }
+
+    const TrajectoryHeader& header = reader.GetHeader();
+    std::cout << header.width << "x" << header.height << ", agents " << header.agent_count
+        << ", every " << header.every << " steps, " << reader.GetFrameCount() << " frames in "
+        << reader.GetChunkCount() << " chunks\n";
+    if (argc == 2) return 0;
+
+    unsigned step = 0;
+    if (!ParseUnsigned(argv[2], step)) {
+        std::cerr << "Invalid step '" << argv[2] << "'\n";
+        return EXIT_FAILURE;
+    }
+
+    TrajectoryFrame frame;
+    if (!reader.Seek(step, frame)) {
+        std::cerr << "No frame at or before step " << step << "\n";
+        return EXIT_FAILURE;
+    }
+
+    const std::string output_path = argc == 4 ? argv[3] : "agents_data.csv";
+    std::ofstream output(output_path);
+    if (!output) {
+        std::cerr << "Error writing '" << output_path << "'\n";
+        return EXIT_FAILURE;
+    }
+
+    output << std::setprecision(std::numeric_limits<float>::max_digits10) << "X;Y;Weight\n";
+    for (size_t i = 0; i < frame.x.size(); ++i) {
+        output << frame.x[i] << ";" << frame.y[i] << ";" << frame.weight[i] << "\n";
+    }
+    std::cout << "Step " << frame.step << " written to '" << output_path << "'\n";
+    return 0;
+}
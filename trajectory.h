@@ -0,0 +1,493 @@
+#pragma once
+#include "domain.h"
+#include "parallel.h"
+#include "agent.h"
+
+#include <array>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#if SLIME_HAS_ZLIB
+#include <zlib.h>
+#endif
+
+// Agent positions and weights every few steps, for offline analysis. Values are
+// quantised to 16 bits (positions relative to the frame, weights to [0, WEIGHT_MAX]),
+// stored as the wrapping difference to a prediction from the previous frames and
+// packed as zigzag varints, so agents that keep their course cost a byte per value;
+// with zlib each chunk is deflated on top. Agents are stored in id order, so a column
+// follows one agent however the pool reorders its slots. Frames are grouped in chunks
+// that start from zero, so a chunk decodes on its own; an index of chunks at the end of
+// the file lets a reader seek. Without the index (the writer was killed) the reader
+// walks the chunk headers instead.
+namespace trajectory {
+    const char MAGIC[8] = { 'S', 'L', 'I', 'M', 'E', 'T', 'R', 'J' };
+    const char INDEX_MAGIC[8] = { 'S', 'L', 'I', 'M', 'E', 'I', 'D', 'X' };
+    const uint32_t CHUNK_MAGIC = 0x4b4e4843;
+    const uint32_t VERSION = 1;
+    const uint32_t ENDIAN_MARK = 0x01020304;
+    const uint32_t FRAMES_PER_CHUNK = 32;
+    const size_t MAX_QUEUED_FRAMES = 8;
+    // Index entries reserved up front; past them the index grows like any vector.
+    const size_t RESERVED_CHUNKS = 1 << 16;
+    const float WEIGHT_MAX = 2.0f;
+    const size_t CHANNEL_COUNT = 3;
+
+    enum Codec : uint32_t { VARINT, VARINT_DEFLATE };
+}
+
+struct TrajectoryHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t endian_mark;
+    uint32_t width;
+    uint32_t height;
+    uint64_t agent_count;
+    uint32_t every;
+    uint32_t frames_per_chunk;
+    float weight_max;
+    uint32_t reserved;
+};
+static_assert(sizeof(TrajectoryHeader) == 48, "trajectory header layout changed");
+
+struct TrajectoryChunkHeader {
+    uint32_t magic;
+    uint32_t frame_count;
+    uint64_t first_step;
+    uint64_t last_step;
+    uint32_t codec;
+    uint32_t reserved;
+    uint64_t encoded_size;  // bytes that follow the header
+    uint64_t decoded_size;  // varint bytes once inflated
+};
+static_assert(sizeof(TrajectoryChunkHeader) == 48, "trajectory chunk header layout changed");
+
+struct TrajectoryIndexEntry {
+    uint64_t offset;
+    uint64_t first_step;
+    uint64_t last_step;
+    uint32_t frame_count;
+    uint32_t reserved;
+};
+
+struct TrajectoryFooter {
+    uint64_t chunk_count;
+    uint64_t index_offset;
+    char magic[8];
+};
+
+// One decoded frame, in agent id order.
+struct TrajectoryFrame {
+    uint64_t step = 0;
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> weight;
+};
+
+inline uint16_t QuantiseTrajectoryValue(float value, float range) {
+    const float scaled = value / range * 65536.0f;
+    return static_cast<uint16_t>(std::clamp(scaled, 0.0f, 65535.0f));
+}
+
+inline float DequantiseTrajectoryValue(uint16_t value, float range) {
+    return (value + 0.5f) * range / 65536.0f;
+}
+
+// Positions continue along their last displacement, weights repeat. Everything wraps
+// modulo 2^16, like an agent crossing the border of a wrapping field.
+inline uint16_t PredictTrajectoryValue(uint16_t last, uint16_t before_last, bool is_position) {
+    return is_position ? static_cast<uint16_t>(2 * last - before_last) : last;
+}
+
+inline void AppendVarint(std::vector<uint8_t>& output, uint64_t value) {
+    while (value >= 0x80) {
+        output.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    output.push_back(static_cast<uint8_t>(value));
+}
+
+inline bool ReadVarint(const std::vector<uint8_t>& input, size_t& position, uint64_t& value) {
+    value = 0;
+    for (unsigned shift = 0; shift < 64 && position < input.size(); shift += 7) {
+        const uint8_t byte = input[position++];
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+// Records from the simulation thread, which only quantises into one of MAX_QUEUED_FRAMES
+// frame buffers; encoding and writing happen on the recorder's own thread. If every buffer
+// is still waiting for that thread, new frames are dropped (and counted) rather than
+// waited for. All buffers, the varint payload of a full chunk and the deflate state are
+// set up front, so recording allocates nothing once running; the payload is reserved for
+// its worst case but only touched as far as chunks actually fill it.
+class TrajectoryRecorder {
+public:
+    TrajectoryRecorder(const std::string& path, unsigned width, unsigned height, size_t agent_count, unsigned every)
+        : output_(path, std::ios::binary | std::ios::trunc), width_(width), height_(height), agent_count_(agent_count) {
+        TrajectoryHeader header{};
+        std::memcpy(header.magic, trajectory::MAGIC, sizeof(header.magic));
+        header.version = trajectory::VERSION;
+        header.endian_mark = trajectory::ENDIAN_MARK;
+        header.width = width;
+        header.height = height;
+        header.agent_count = agent_count;
+        header.every = every;
+        header.frames_per_chunk = trajectory::FRAMES_PER_CHUNK;
+        header.weight_max = trajectory::WEIGHT_MAX;
+        output_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        previous_.assign(agent_count * trajectory::CHANNEL_COUNT, 0);
+        before_previous_.assign(previous_.size(), 0);
+        for (Frame& frame : frames_) frame.values.assign(previous_.size(), 0);
+        index_.reserve(trajectory::RESERVED_CHUNKS);
+
+        // A step and three zigzag varints of at most 10 and 3 bytes per agent and frame.
+        const size_t max_payload = trajectory::FRAMES_PER_CHUNK * (10 + 3 * previous_.size());
+        payload_.reserve(max_payload);
+#if SLIME_HAS_ZLIB
+        is_deflating_ = deflateInit(&stream_, Z_BEST_SPEED) == Z_OK;
+        if (is_deflating_) deflated_.reserve(deflateBound(&stream_, static_cast<uLong>(max_payload)));
+#endif
+        thread_ = std::thread([this] { WriterLoop(); });
+    }
+
+    // Drains the queue, then writes the chunk index.
+    ~TrajectoryRecorder() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_one();
+        thread_.join();
+#if SLIME_HAS_ZLIB
+        if (is_deflating_) deflateEnd(&stream_);
+#endif
+        if (dropped_ != 0) std::cerr << "Trajectory: " << dropped_ << " frames dropped, the writer fell behind\n";
+    }
+
+    TrajectoryRecorder(const TrajectoryRecorder&) = delete;
+    TrajectoryRecorder& operator=(const TrajectoryRecorder&) = delete;
+
+    bool IsOpen() const { return static_cast<bool>(output_); }
+
+    // The ids of a fixed population are 0 to agent_count - 1, so each agent is scattered to
+    // its own column.
+    void Record(unsigned long long step, const AgentPool& agents, ThreadPool& pool) {
+        size_t slot = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (queued_ == trajectory::MAX_QUEUED_FRAMES) {
+                ++dropped_;
+                return;
+            }
+            // The writer only reads queued buffers, so this one is ours until it is queued.
+            slot = (first_queued_ + queued_) % trajectory::MAX_QUEUED_FRAMES;
+        }
+
+        Frame& frame = frames_[slot];
+        frame.step = step;
+        uint16_t* x = frame.values.data();
+        uint16_t* y = x + agent_count_;
+        uint16_t* weight = y + agent_count_;
+        const std::vector<uint32_t>& ids = agents.GetIds();
+        pool.ParallelFor(std::min(agents.Size(), agent_count_), 1 << 16, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                const uint32_t id = ids[i];
+                if (id >= agent_count_) continue;
+                const Vector2f position = agents.GetPos(i);
+                x[id] = QuantiseTrajectoryValue(position.x, static_cast<float>(width_));
+                y[id] = QuantiseTrajectoryValue(position.y, static_cast<float>(height_));
+                weight[id] = QuantiseTrajectoryValue(agents.GetWeight(i), trajectory::WEIGHT_MAX);
+            }
+            });
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++queued_;
+        }
+        wake_.notify_one();
+    }
+
+private:
+    struct Frame {
+        unsigned long long step = 0;
+        std::vector<uint16_t> values;  // x, then y, then weight
+    };
+
+    std::ofstream output_;
+    unsigned width_;
+    unsigned height_;
+    size_t agent_count_;
+
+    // A ring of frame buffers: queued_ of them from first_queued_ on wait for the writer.
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::array<Frame, trajectory::MAX_QUEUED_FRAMES> frames_;
+    size_t first_queued_ = 0;
+    size_t queued_ = 0;
+    unsigned long long dropped_ = 0;
+    bool stop_ = false;
+    std::thread thread_;
+
+    // Writer thread state.
+    std::vector<uint16_t> previous_;
+    std::vector<uint16_t> before_previous_;
+    std::vector<uint8_t> payload_;
+    std::vector<uint8_t> deflated_;
+#if SLIME_HAS_ZLIB
+    z_stream stream_{};
+    bool is_deflating_ = false;
+#endif
+    TrajectoryChunkHeader chunk_{};
+    std::vector<TrajectoryIndexEntry> index_;
+
+    void WriterLoop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            wake_.wait(lock, [this] { return stop_ || queued_ != 0; });
+            if (queued_ == 0) break;
+
+            const Frame& frame = frames_[first_queued_];
+            lock.unlock();
+
+            Encode(frame);
+            if (chunk_.frame_count == trajectory::FRAMES_PER_CHUNK) FlushChunk();
+
+            lock.lock();
+            first_queued_ = (first_queued_ + 1) % trajectory::MAX_QUEUED_FRAMES;
+            --queued_;
+        }
+        lock.unlock();
+
+        FlushChunk();
+        WriteIndex();
+    }
+
+    void Encode(const Frame& frame) {
+        if (chunk_.frame_count == 0) {
+            std::fill(previous_.begin(), previous_.end(), 0);
+            std::fill(before_previous_.begin(), before_previous_.end(), 0);
+            chunk_.first_step = frame.step;
+        }
+        chunk_.last_step = frame.step;
+        ++chunk_.frame_count;
+
+        AppendVarint(payload_, frame.step);
+        for (size_t i = 0; i < frame.values.size(); ++i) {
+            const bool is_position = i < 2 * agent_count_;
+            const uint16_t prediction = PredictTrajectoryValue(previous_[i], before_previous_[i], is_position);
+            const uint16_t delta = static_cast<uint16_t>(frame.values[i] - prediction);
+            const uint16_t zigzag = static_cast<uint16_t>((delta << 1) ^ (delta & 0x8000 ? 0xffff : 0));
+            AppendVarint(payload_, zigzag);
+        }
+        // A chunk's first frame has no motion to extrapolate yet.
+        before_previous_ = chunk_.frame_count == 1 ? frame.values : previous_;
+        previous_ = frame.values;
+    }
+
+    void FlushChunk() {
+        if (chunk_.frame_count == 0) return;
+
+        chunk_.magic = trajectory::CHUNK_MAGIC;
+        chunk_.decoded_size = payload_.size();
+        const std::vector<uint8_t>* encoded = &payload_;
+        chunk_.codec = trajectory::VARINT;
+#if SLIME_HAS_ZLIB
+        // One stream reset per chunk, where compress2 would set up and free its state each time.
+        if (is_deflating_ && deflateReset(&stream_) == Z_OK) {
+            deflated_.resize(deflateBound(&stream_, static_cast<uLong>(payload_.size())));
+            stream_.next_in = payload_.data();
+            stream_.avail_in = static_cast<uInt>(payload_.size());
+            stream_.next_out = deflated_.data();
+            stream_.avail_out = static_cast<uInt>(deflated_.size());
+            if (deflate(&stream_, Z_FINISH) == Z_STREAM_END) {
+                deflated_.resize(stream_.total_out);
+                encoded = &deflated_;
+                chunk_.codec = trajectory::VARINT_DEFLATE;
+            }
+        }
+#endif
+        chunk_.encoded_size = encoded->size();
+
+        index_.push_back({ static_cast<uint64_t>(output_.tellp()), chunk_.first_step, chunk_.last_step, chunk_.frame_count, 0 });
+        output_.write(reinterpret_cast<const char*>(&chunk_), sizeof(chunk_));
+        output_.write(reinterpret_cast<const char*>(encoded->data()), encoded->size());
+        output_.flush();
+
+        chunk_ = TrajectoryChunkHeader{};
+        payload_.clear();
+    }
+
+    void WriteIndex() {
+        TrajectoryFooter footer{};
+        footer.chunk_count = index_.size();
+        footer.index_offset = static_cast<uint64_t>(output_.tellp());
+        std::memcpy(footer.magic, trajectory::INDEX_MAGIC, sizeof(footer.magic));
+        output_.write(reinterpret_cast<const char*>(index_.data()), index_.size() * sizeof(TrajectoryIndexEntry));
+        output_.write(reinterpret_cast<const char*>(&footer), sizeof(footer));
+        output_.flush();
+    }
+};
+
+// Random access to a recorded trajectory. Seek decodes only the chunk holding the
+// requested step, and continues from the last decoded frame when reading forward.
+class TrajectoryReader {
+public:
+    bool Open(const std::string& path) {
+        input_.close();
+        input_.clear();
+        index_.clear();
+        loaded_chunk_ = NO_CHUNK;
+
+        input_.open(path, std::ios::binary);
+        if (!input_.read(reinterpret_cast<char*>(&header_), sizeof(header_))) return false;
+        if (std::memcmp(header_.magic, trajectory::MAGIC, sizeof(header_.magic)) != 0) return false;
+        if (header_.version != trajectory::VERSION || header_.endian_mark != trajectory::ENDIAN_MARK) return false;
+
+        input_.seekg(0, std::ios::end);
+        file_size_ = static_cast<uint64_t>(input_.tellg());
+        if (!ReadIndex()) ScanChunks();
+        current_.assign(header_.agent_count * trajectory::CHANNEL_COUNT, 0);
+        before_current_.assign(current_.size(), 0);
+        return true;
+    }
+
+    const TrajectoryHeader& GetHeader() const { return header_; }
+    size_t GetChunkCount() const { return index_.size(); }
+
+    uint64_t GetFrameCount() const {
+        uint64_t count = 0;
+        for (const auto& entry : index_) count += entry.frame_count;
+        return count;
+    }
+
+    // The last recorded frame at or before `step`; false if the recording starts later.
+    bool Seek(uint64_t step, TrajectoryFrame& frame) {
+        auto chunk = std::upper_bound(index_.begin(), index_.end(), step,
+            [](uint64_t value, const TrajectoryIndexEntry& entry) { return value < entry.first_step; });
+        if (chunk == index_.begin()) return false;
+        const size_t chunk_index = static_cast<size_t>(chunk - index_.begin()) - 1;
+
+        if (chunk_index != loaded_chunk_ || step < current_step_) {
+            if (!LoadChunk(chunk_index)) return false;
+        }
+
+        // Decode forward while the next frame is still at or before `step`.
+        while (decoded_frames_ < index_[chunk_index].frame_count) {
+            size_t position = cursor_;
+            uint64_t next_step = 0;
+            if (!ReadVarint(payload_, position, next_step)) return false;
+            if (decoded_frames_ > 0 && next_step > step) break;
+            if (!DecodeFrame()) return false;
+        }
+
+        const size_t count = header_.agent_count;
+        frame.step = current_step_;
+        frame.x.resize(count);
+        frame.y.resize(count);
+        frame.weight.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            frame.x[i] = DequantiseTrajectoryValue(current_[i], static_cast<float>(header_.width));
+            frame.y[i] = DequantiseTrajectoryValue(current_[count + i], static_cast<float>(header_.height));
+            frame.weight[i] = DequantiseTrajectoryValue(current_[2 * count + i], header_.weight_max);
+        }
+        return true;
+    }
+
+private:
+    static constexpr size_t NO_CHUNK = std::numeric_limits<size_t>::max();
+
+    std::ifstream input_;
+    TrajectoryHeader header_{};
+    uint64_t file_size_ = 0;
+    std::vector<TrajectoryIndexEntry> index_;
+
+    size_t loaded_chunk_ = NO_CHUNK;
+    std::vector<uint8_t> encoded_;
+    std::vector<uint8_t> payload_;
+    size_t cursor_ = 0;
+    uint32_t decoded_frames_ = 0;
+    uint64_t current_step_ = 0;
+    std::vector<uint16_t> current_;
+    std::vector<uint16_t> before_current_;
+
+    bool ReadIndex() {
+        TrajectoryFooter footer{};
+        if (file_size_ < sizeof(header_) + sizeof(footer)) return false;
+        input_.seekg(file_size_ - sizeof(footer));
+        if (!input_.read(reinterpret_cast<char*>(&footer), sizeof(footer))) return false;
+        if (std::memcmp(footer.magic, trajectory::INDEX_MAGIC, sizeof(footer.magic)) != 0) return false;
+        if (footer.index_offset + footer.chunk_count * sizeof(TrajectoryIndexEntry) + sizeof(footer) != file_size_) return false;
+
+        index_.resize(footer.chunk_count);
+        input_.seekg(footer.index_offset);
+        return static_cast<bool>(input_.read(reinterpret_cast<char*>(index_.data()), index_.size() * sizeof(TrajectoryIndexEntry)));
+    }
+
+    // Recovers the index from the chunk headers, stopping at the first torn chunk.
+    void ScanChunks() {
+        input_.clear();
+        index_.clear();
+        uint64_t offset = sizeof(header_);
+        TrajectoryChunkHeader chunk{};
+        while (offset + sizeof(chunk) <= file_size_) {
+            input_.seekg(offset);
+            if (!input_.read(reinterpret_cast<char*>(&chunk), sizeof(chunk)) || chunk.magic != trajectory::CHUNK_MAGIC) break;
+            if (chunk.encoded_size > file_size_ - offset - sizeof(chunk)) break;
+            index_.push_back({ offset, chunk.first_step, chunk.last_step, chunk.frame_count, 0 });
+            offset += sizeof(chunk) + chunk.encoded_size;
+        }
+        input_.clear();
+    }
+
+    bool LoadChunk(size_t chunk_index) {
+        TrajectoryChunkHeader chunk{};
+        input_.seekg(index_[chunk_index].offset);
+        if (!input_.read(reinterpret_cast<char*>(&chunk), sizeof(chunk)) || chunk.magic != trajectory::CHUNK_MAGIC) return false;
+        encoded_.resize(chunk.encoded_size);
+        if (!input_.read(reinterpret_cast<char*>(encoded_.data()), encoded_.size())) return false;
+
+        if (chunk.codec == trajectory::VARINT) {
+            payload_.swap(encoded_);
+        }
+        else {
+#if SLIME_HAS_ZLIB
+            if (chunk.codec != trajectory::VARINT_DEFLATE) return false;
+            uLongf inflated_size = static_cast<uLongf>(chunk.decoded_size);
+            payload_.resize(chunk.decoded_size);
+            if (uncompress(payload_.data(), &inflated_size, encoded_.data(), static_cast<uLong>(encoded_.size())) != Z_OK) return false;
+            if (inflated_size != chunk.decoded_size) return false;
+#else
+            return false;
+#endif
+        }
+
+        loaded_chunk_ = chunk_index;
+        cursor_ = 0;
+        decoded_frames_ = 0;
+        std::fill(current_.begin(), current_.end(), 0);
+        std::fill(before_current_.begin(), before_current_.end(), 0);
+        return true;
+    }
+
+    bool DecodeFrame() {
+        if (!ReadVarint(payload_, cursor_, current_step_)) return false;
+        const size_t position_values = 2 * header_.agent_count;
+        for (size_t i = 0; i < current_.size(); ++i) {
+            uint64_t zigzag = 0;
+            if (!ReadVarint(payload_, cursor_, zigzag)) return false;
+            const uint16_t delta = static_cast<uint16_t>((zigzag >> 1) ^ (zigzag & 1 ? 0xffff : 0));
+            const uint16_t last = current_[i];
+            current_[i] = static_cast<uint16_t>(PredictTrajectoryValue(last, before_current_[i], i < position_values) + delta);
+            before_current_[i] = decoded_frames_ == 0 ? current_[i] : last;
+        }
+        ++decoded_frames_;
+        return true;
+    }
+};